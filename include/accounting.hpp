@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include "Decl.hpp"
+#include "slots.hpp"
+
+// Per-thread time breakdown of the backends:
+//     Lock: time spent holding a backend lock (LibAIO cntMtx, the shared fstream mutex)
+//     IO:   time inside the call that does or submits the I/O (pwrite, io_submit, fsync, ...)
+//     Wait: time waiting for completions (aio_error polling, io_getevents)
+// Slots live in shared anonymous memory so forked worker processes are accounted too,
+// one per thread of the run.
+class Accounting
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    enum Kind { Lock, IO, Wait, KINDS };
+
+    struct alignas(64) Slot
+    {
+        std::atomic<long long> ns[KINDS];
+    };
+
+    bool enabled = true;
+
+    Accounting(size_t threads) : slots(threads) {}
+
+    void resize(size_t threads)
+    {
+        slots.resize(threads);
+    }
+
+    TAI_INLINE
+    clock::time_point now() const
+    {
+        return enabled ? clock::now() : clock::time_point();
+    }
+
+    // Single writer per slot, so no read-modify-write is needed.
+    TAI_INLINE
+    void add(size_t tid, Kind k, clock::time_point start)
+    {
+        if (!enabled)
+            return;
+        auto& c = slots[tid].ns[k];
+        c.store(c.load(std::memory_order_relaxed)
+                + std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count(),
+                std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        for (size_t i = 0; i < slots.size(); ++i)
+            for (auto& j : slots[i].ns)
+                j.store(0);
+    }
+
+    long long get(size_t tid, Kind k) const
+    {
+        return slots[tid].ns[k].load(std::memory_order_relaxed);
+    }
+
+    long long total(Kind k) const
+    {
+        long long sum = 0;
+        for (size_t i = 0; i < slots.size(); ++i)
+            sum += get(i, k);
+        return sum;
+    }
+
+    // Accounts [construction, destruction) of a scope.
+    class Scope
+    {
+        Accounting& acct;
+        size_t tid;
+        Kind kind;
+        clock::time_point start;
+
+    public:
+        TAI_INLINE
+        Scope(Accounting& acct, size_t tid, Kind kind) : acct(acct), tid(tid), kind(kind), start(acct.now()) {}
+
+        TAI_INLINE
+        ~Scope()
+        {
+            acct.add(tid, kind, start);
+        }
+    };
+
+    // unique_lock that accounts how long the lock is held.
+    template<typename M>
+    class HeldLock
+    {
+        Accounting& acct;
+        size_t tid;
+        std::unique_lock<M> lck;
+        clock::time_point since;
+
+    public:
+        TAI_INLINE
+        HeldLock(Accounting& acct, size_t tid, M& mtx) : acct(acct), tid(tid), lck(mtx, std::defer_lock) {}
+
+        TAI_INLINE
+        ~HeldLock()
+        {
+            if (lck.owns_lock())
+                unlock();
+        }
+
+        TAI_INLINE
+        void lock()
+        {
+            lck.lock();
+            since = acct.now();
+        }
+
+        TAI_INLINE
+        void unlock()
+        {
+            acct.add(tid, Lock, since);
+            lck.unlock();
+        }
+    };
+
+private:
+    SharedSlots<Slot> slots;
+};
+
+// Ops handed to the coalescer and the calls it issued for them, per thread,
+// in shared memory like Accounting.
+class MergeStats
+{
+public:
+    struct alignas(64) Slot
+    {
+        std::atomic<size_t> ops;
+        std::atomic<size_t> calls;
+    };
+
+    MergeStats(size_t threads) : slots(threads) {}
+
+    void resize(size_t threads)
+    {
+        slots.resize(threads);
+    }
+
+    TAI_INLINE
+    void add(size_t tid, size_t ops, size_t calls)
+    {
+        auto& s = slots[tid];
+        s.ops.store(s.ops.load(std::memory_order_relaxed) + ops, std::memory_order_relaxed);
+        s.calls.store(s.calls.load(std::memory_order_relaxed) + calls, std::memory_order_relaxed);
+    }
+
+    void reset()
+    {
+        for (size_t i = 0; i < slots.size(); ++i)
+        {
+            slots[i].ops.store(0);
+            slots[i].calls.store(0);
+        }
+    }
+
+    size_t ops() const
+    {
+        size_t sum = 0;
+        for (size_t i = 0; i < slots.size(); ++i)
+            sum += slots[i].ops.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    size_t calls() const
+    {
+        size_t sum = 0;
+        for (size_t i = 0; i < slots.size(); ++i)
+            sum += slots[i].calls.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    SharedSlots<Slot> slots;
+};
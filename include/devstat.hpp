@@ -0,0 +1,113 @@
+#pragma once
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__MACH__)
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+#include "tai.hpp"
+
+// Where written bytes end up: what the process issued (/proc/self/io), what
+// the page cache still holds dirty or under writeback (/proc/vmstat), and
+// what reached the block devices holding the test directories
+// (/sys/dev/block/MAJ:MIN/stat).  Reaped worker processes are included in
+// /proc/self/io; devices of in-memory or overlay filesystems have no stat
+// and are skipped.
+class DevStat
+{
+public:
+    struct Snapshot
+    {
+        std::map<std::string, long long> io, vm;
+        std::map<std::string, std::vector<long long>> dev;
+    };
+
+    DevStat(const std::vector<std::string>& dirs)
+    {
+        #ifdef __linux__
+        for (auto& d : dirs)
+        {
+            struct stat st;
+            if (stat(d.c_str(), &st))
+                continue;
+            auto dev = std::to_string(major(st.st_dev)) + ":" + std::to_string(minor(st.st_dev));
+            if (std::ifstream("/sys/dev/block/" + dev + "/stat"))
+                devs.emplace(dev, d);
+        }
+        #endif
+    }
+
+    Snapshot snapshot() const
+    {
+        Snapshot s;
+        std::ifstream fio("/proc/self/io");
+        std::string key;
+        for (long long val; fio >> key >> val; )
+            s.io[key.substr(0, key.size() - 1)] = val;
+        std::ifstream fvm("/proc/vmstat");
+        for (long long val; fvm >> key >> val; )
+            if (key == "nr_dirty" || key == "nr_writeback" || key == "nr_dirtied" || key == "nr_written")
+                s.vm[key] = val;
+        for (auto& d : devs)
+        {
+            std::ifstream fdev("/sys/dev/block/" + d.first + "/stat");
+            auto& fields = s.dev[d.first];
+            for (long long val; fdev >> val; fields.emplace_back(val));
+        }
+        return s;
+    }
+
+    // issued: bytes the run wrote, for writes /proc/self/io does not count as
+    // wchar (splice, sendfile, copy_file_range); -1 to take wchar.
+    void report(const Snapshot& a, const Snapshot& b, long long issued = -1) const
+    {
+        using namespace tai;
+
+        static const long long page = 4096, sector = 512;
+
+        if (issued < 0)
+            issued = get(b.io, "wchar") - get(a.io, "wchar");
+        auto storage = get(b.io, "write_bytes") - get(a.io, "write_bytes");
+        auto cancelled = get(b.io, "cancelled_write_bytes") - get(a.io, "cancelled_write_bytes");
+        Log::log("devstat: ", issued / 1048576., " MB issued, ", storage / 1048576., " MB accounted to storage, ",
+                cancelled / 1048576., " MB cancelled, ", (get(b.io, "syscr") - get(a.io, "syscr")), " read / ",
+                (get(b.io, "syscw") - get(a.io, "syscw")), " write syscalls");
+        Log::log("devstat: ", (get(b.vm, "nr_dirtied") - get(a.vm, "nr_dirtied")) * page / 1048576., " MB dirtied, ",
+                (get(b.vm, "nr_written") - get(a.vm, "nr_written")) * page / 1048576., " MB written back system-wide, ",
+                get(b.vm, "nr_dirty") * page / 1048576., " MB dirty and ",
+                get(b.vm, "nr_writeback") * page / 1048576., " MB under writeback at exit (",
+                (get(b.vm, "nr_dirty") - get(a.vm, "nr_dirty")) * page / 1048576., " MB dirty more than at start)");
+        for (auto& d : devs)
+        {
+            auto& x = a.dev.at(d.first);
+            auto& y = b.dev.at(d.first);
+            if (x.size() < 7 || y.size() < 7)
+                continue;
+            // Fields 5-7: writes completed, merged, sectors written.
+            auto written = (y[6] - x[6]) * sector;
+            Log::log("devstat: ", d.second, " (", d.first, "): ", (y[4] - x[4]), " writes, ", (y[5] - x[5]), " merged, ",
+                    written / 1048576., " MB written, amplification ", issued ? (double)written / issued : 0.,
+                    ", ", (y[0] - x[0]), " reads, ", (y[2] - x[2]) * sector / 1048576., " MB read");
+        }
+        if (devs.empty())
+            Log::log("devstat: no block device statistics for the test directories");
+    }
+
+private:
+    std::map<std::string, std::string> devs;    // MAJ:MIN -> first test dir on it
+
+    static long long get(const std::map<std::string, long long>& m, const std::string& key)
+    {
+        auto it = m.find(key);
+        return it == m.end() ? 0 : it->second;
+    }
+};
@@ -4,18 +4,24 @@
 #include <chrono>
 #include <thread>
 #include <array>
+#include <algorithm>
 #include <vector>
 #include <limits>
 #include <numeric>
 #include <functional>
 #include <new>
 #include <string>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <atomic>
+#include <map>
+#include <sstream>
 
 #if defined(__unix__) || defined(__MACH__)
 #include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef _POSIX_VERSION
@@ -25,17 +31,32 @@
 #endif
 
 #ifdef __linux__
+#include <poll.h>
+#include <signal.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sched.h>
 #include <libaio.h>
 #endif
 
 #include "tai.hpp"
+#include "placement.hpp"
+#include "monitor.hpp"
+#include "workload.hpp"
+#include "accounting.hpp"
+#include "schedule.hpp"
+#include "usage.hpp"
+#include "devstat.hpp"
+#include "residency.hpp"
+#include "payload.hpp"
+#include "waitpolicy.hpp"
+#include "jobfile.hpp"
 // #include "aio.hpp"
 
 #define unlikely(x)     __builtin_expect((x),0)
 
-static const std::string testname[] = {"Posix", "DIO", "STL", "PosixAIO", "LibAIO", "TaiAIO", "Tai"};
-static const std::string wlname[] = {"read", "write", "read&write"};
+static const std::string testname[] = {"Posix", "DIO", "STL", "PosixAIO", "LibAIO", "TaiAIO", "Tai", "Null"};
+static const std::string wlname[] = {"read", "write", "read&write", "mixed"};
 
 extern size_t testType;
 extern size_t FILE_SIZE;
@@ -53,52 +74,710 @@ extern size_t SYNC_RATE;
 extern size_t WAIT_RATE;
 
 extern size_t SINGLE_FILE;
+extern size_t FILE_NUM;
+extern std::vector<std::string> FILE_DIRS;
+extern std::string PIN_POLICY;
+extern size_t NUMA_LOCAL;
+extern thread_local Placement placement;
+extern Monitor monitor;
+extern Workload mixgen;
+extern size_t STL_SHARED;
+extern ssize_t STL_BUF;
+extern size_t PROC_MODE;
+extern std::string TARGET;
+extern std::string TMPFS_DIR;
+extern size_t AIO_FSYNC;
+extern size_t TX_CHAIN;
+extern size_t VECTORED;
+extern MergeStats merges;
+extern uint64_t SEED;
+extern std::string META_SYNC;
+extern size_t META_DIRSYNC;
+extern std::string META_LAYOUT;
+extern size_t META_APPENDS;
+extern std::string ACCESS;
+extern size_t STRIDE;
+extern std::string FADVISE;
+extern size_t PREFETCH;
+extern size_t FINAL_SYNC;
+extern size_t RESIDENCY;
+extern Payload PAYLOAD;
+extern WaitPolicy WAIT;
+extern double PROBE_RATE;
+extern size_t PROBE_SYNC;
+extern std::string KV_MIX;
+extern double ZIPF_THETA;
+extern size_t KV_VALUE;
+extern size_t KV_KEYS;
+extern size_t CHASE_DEPTH;
+extern std::string COPY_METHOD;
+extern JobFile JOB;
+extern size_t PHASE;
+extern Accounting breakdown;
 
 static constexpr size_t MAX_THREAD_NUM = 8;
 
+extern std::vector<Schedule> schedules;   // one per thread, sized by settleArgs()
+
+static auto split(const std::string& str, char delim)
+{
+    std::vector<std::string> res;
+    std::istringstream ss(str);
+    for (std::string item; std::getline(ss, item, delim); )
+        if (!item.empty())
+            res.emplace_back(item);
+    return res;
+}
+
+// Index of v in names, or v itself if it is a number.
+static size_t name_index(const std::string* names, size_t n, const std::string& v)
+{
+    auto it = std::find(names, names + n, v);
+    return it != names + n ? it - names : std::stoull(v);
+}
+
+static void apply_phase(size_t phase);
+
+// Sets the "name=value" option name; false if there is none.  The positional
+// arguments have options too, taking plain values instead of log2 and KB.
+static bool set_option(const std::string& name, const std::string& value)
+{
+    using namespace std;
+
+    static const map<string, function<void(const string&)>> opts = {
+        {"backend",    [](const string& v){ testType = name_index(testname, size(testname), v); }},
+        {"workload",   [](const string& v){ workload = name_index(wlname, size(wlname), v); }},
+        {"threads",    [](const string& v){ thread_num = stoull(v); }},
+        {"single",     [](const string& v){ SINGLE_FILE = stoull(v); }},
+        {"file_size",  [](const string& v){ FILE_SIZE = parse_size(v); }},
+        {"read_size",  [](const string& v){ READ_SIZE = parse_size(v); }},
+        {"write_size", [](const string& v){ WRITE_SIZE = parse_size(v); }},
+        {"rounds",     [](const string& v){ IO_ROUND = stoull(v); }},
+        {"sync_rate",  [](const string& v){ SYNC_RATE = stoull(v); }},   // powers of two
+        {"wait_rate",  [](const string& v){ WAIT_RATE = stoull(v); }},
+        {"job",   [](const string& v){ JOB.load(v); apply_phase(PHASE = 0); }},
+        {"files", [](const string& v){ FILE_NUM = stoull(v); }},
+        {"dirs",  [](const string& v){ FILE_DIRS = split(v, ','); }},
+        {"pin",   [](const string& v){ PIN_POLICY = v; }},
+        {"numa",  [](const string& v){ NUMA_LOCAL = stoull(v); }},
+        {"duration", [](const string& v){ monitor.duration = stod(v); }},
+        {"warmup",   [](const string& v){ monitor.warmup = stod(v); }},
+        {"interval", [](const string& v){ monitor.interval = stod(v); }},
+        {"timeline", [](const string& v){ monitor.timeline = stoull(v); }},
+        {"prom",     [](const string& v){ monitor.prom = v; monitor.timeline = 1; }},
+        {"steady",   [](const string& v){   // <window>:<threshold>, e.g. 10:0.05
+            auto colon = v.find(':');
+            monitor.window = stoull(v.substr(0, colon));
+            monitor.threshold = colon == string::npos ? 0.05 : stod(v.substr(colon + 1));
+        }},
+        {"mix",   [](const string& v){ mixgen.read_ratio = stod(v) / 100; }},   // read percentage
+        {"bs",    [](const string& v){ mixgen.rbs = mixgen.wbs = SizeDist(v); }},
+        {"rbs",   [](const string& v){ mixgen.rbs = SizeDist(v); }},
+        {"wbs",   [](const string& v){ mixgen.wbs = SizeDist(v); }},
+        {"rsync", [](const string& v){ mixgen.rsync = stod(v); }},
+        {"wsync", [](const string& v){ mixgen.wsync = stod(v); }},
+        {"stlshared", [](const string& v){ STL_SHARED = stoull(v); }},
+        {"stlbuf",    [](const string& v){ STL_BUF = parse_size(v); }},
+        {"procs",     [](const string& v){ PROC_MODE = stoull(v); }},
+        {"target",    [](const string& v){ TARGET = v; }},
+        {"tmpfs",     [](const string& v){ TMPFS_DIR = v; }},
+        {"aiofsync",  [](const string& v){ AIO_FSYNC = stoull(v); }},
+        {"txchain",   [](const string& v){ TX_CHAIN = stoull(v); }},
+        {"vectored",  [](const string& v){ VECTORED = stoull(v); }},
+        {"seed",      [](const string& v){ SEED = stoull(v); }},
+        {"msync",     [](const string& v){ META_SYNC = v; }},
+        {"dirsync",   [](const string& v){ META_DIRSYNC = stoull(v); }},
+        {"layout",    [](const string& v){ META_LAYOUT = v; }},
+        {"appends",   [](const string& v){ META_APPENDS = stoull(v); }},
+        {"access",    [](const string& v){   // random, seq or stride:<bytes>
+            auto colon = v.find(':');
+            ACCESS = v.substr(0, colon);
+            STRIDE = colon == string::npos ? 0 : parse_size(v.substr(colon + 1));
+        }},
+        {"fadvise",   [](const string& v){ FADVISE = v; }},
+        {"prefetch",  [](const string& v){ PREFETCH = parse_size(v); }},
+        {"finalsync", [](const string& v){ FINAL_SYNC = stoull(v); }},
+        {"residency", [](const string& v){ RESIDENCY = stoull(v); }},
+        {"payload",   [](const string& v){ PAYLOAD.parse(v); }},
+        {"wait",      [](const string& v){ WAIT.parse(v); }},
+        {"spin",      [](const string& v){ WAIT.spin = 1000 * stoll(v); }},   // us
+        {"probe",     [](const string& v){ PROBE_RATE = stod(v); }},          // ops/s
+        {"probesync", [](const string& v){ PROBE_SYNC = stoull(v); }},
+        {"kvmix",     [](const string& v){ KV_MIX = v; }},                    // get:put:delete
+        {"zipf",      [](const string& v){ ZIPF_THETA = stod(v); }},
+        {"value",     [](const string& v){ KV_VALUE = parse_size(v); }},
+        {"keys",      [](const string& v){ KV_KEYS = stoull(v); }},
+        {"depth",     [](const string& v){ CHASE_DEPTH = stoull(v); }},
+        {"copy",      [](const string& v){ COPY_METHOD = v; }},             // rw, cfr, splice or sendfile
+        {"acct",      [](const string& v){ breakdown.enabled = stoull(v); }}
+    };
+
+    auto opt = opts.find(name);
+    if (opt == opts.end())
+        return false;
+    opt->second(value);
+    return true;
+}
+
+// Settings of a job file phase on top of the current ones, then the command
+// line overrides.  Mix block sizes and the write sync probability follow the
+// sizes and sync rate again when a phase changes those without setting them.
+static void apply_phase(size_t phase)
+{
+    using namespace std;
+
+    auto& p = JOB.phases[phase];
+    auto has = [&](const char* key){
+        auto is = [&](auto& s){ return s.first == key; };
+        return any_of(p.settings.begin(), p.settings.end(), is) || any_of(JOB.overrides.begin(), JOB.overrides.end(), is);
+    };
+    if (has("read_size") && !has("rbs") && !has("bs"))
+        mixgen.rbs = SizeDist();
+    if (has("write_size") && !has("wbs") && !has("bs"))
+        mixgen.wbs = SizeDist();
+    if (has("sync_rate") && !has("wsync"))
+        mixgen.wsync = -1;
+    for (auto& s : p.settings)
+        if (!set_option(s.first, s.second))
+        {
+            cerr << "Unknown option \"" << s.first << "\" in phase " << p.name << " of " << JOB.path << "." << endl;
+            exit(-1);
+        }
+    for (auto& s : JOB.overrides)
+        set_option(s.first, s.second);
+}
+
+static void check_options()
+{
+    using namespace std;
+
+    if (TARGET != "file" && TARGET != "memfd" && TARGET != "tmpfs")
+    {
+        cerr << "Unknown target \"" << TARGET << "\"." << endl;
+        exit(-1);
+    }
+
+    if (ACCESS != "random" && ACCESS != "seq" && (ACCESS != "stride" || !STRIDE))
+    {
+        cerr << "Unknown access pattern \"" << ACCESS << "\"." << endl;
+        exit(-1);
+    }
+
+    if (FILE_DIRS.empty())
+    {
+        cerr << "Need at least one directory for test files." << endl;
+        exit(-1);
+    }
+
+    // Sync and wait points are found with masks.
+    if (!SYNC_RATE || (SYNC_RATE & (SYNC_RATE - 1)) || !WAIT_RATE || (WAIT_RATE & (WAIT_RATE - 1)))
+    {
+        cerr << "Sync and wait rates must be powers of two." << endl;
+        exit(-1);
+    }
+
+    // randgen() draws whole blocks from a thread's region.
+    auto blk = max(READ_SIZE, WRITE_SIZE);
+    if (workload == 3)
+        blk = max({blk, mixgen.rbs.max(), mixgen.wbs.max()});
+    auto region = SINGLE_FILE == 2 && thread_num ? FILE_SIZE / thread_num : FILE_SIZE;
+    if (region < blk)
+    {
+        cerr << "Regions of " << region << " B hold no block of " << blk << " B." << endl;
+        exit(-1);
+    }
+}
+
+// Trailing "name=value" arguments after the positional ones.
+static void processOpts(int argc, char* argv[], size_t off)
+{
+    using namespace std;
+
+    for (; off < argc; ++off)
+    {
+        string arg(argv[off]);
+        auto eq = arg.find('=');
+        if (eq == string::npos || !set_option(arg.substr(0, eq), arg.substr(eq + 1)))
+        {
+            cerr << "Unknown option \"" << arg << "\"." << endl;
+            exit(-1);
+        }
+        if (arg.compare(0, eq, "job"))
+            JOB.overrides.emplace_back(arg.substr(0, eq), arg.substr(eq + 1));
+    }
+    check_options();
+}
+
+// SINGLE_FILE: 0 for FILE_NUM (default: one per thread) files spread across FILE_DIRS,
+//              1 for one file shared by all threads,
+//              2 for one file split into a disjoint region per thread.
+TAI_INLINE
+static size_t file_count()
+{
+    if (SINGLE_FILE)
+        return 1;
+    return FILE_NUM && FILE_NUM < thread_num ? FILE_NUM : thread_num;
+}
+
+TAI_INLINE
+static std::string file_path(size_t tid)
+{
+    auto idx = tid % file_count();
+    return FILE_DIRS[idx % FILE_DIRS.size()] + "/file" + std::to_string(idx);
+}
+
+// Derived settings and the log of the configuration, after every phase change.
+static void settleArgs()
+{
+    using namespace std;
+    using namespace tai;
+
+    if (!JOB.phases.empty())
+        Log::log("phase: ", JOB.phases[PHASE].name, " (", PHASE + 1, " of ", JOB.phases.size(), ")");
+
+    // The mixed workload sizes buffers and offsets for its largest blocks.
+    if (!mixgen.rbs.max())
+        mixgen.rbs = SizeDist(READ_SIZE);
+    if (!mixgen.wbs.max())
+        mixgen.wbs = SizeDist(WRITE_SIZE);
+    if (mixgen.wsync < 0)
+        mixgen.wsync = 1. / SYNC_RATE;
+    if (workload == 3)
+    {
+        READ_SIZE = mixgen.rbs.max();
+        WRITE_SIZE = mixgen.wbs.max();
+        Log::log("mix: ", mixgen.read_ratio * 100, "% reads of ", mixgen.rbs.str(), " B, writes of ", mixgen.wbs.str(),
+                " B, sync probability ", mixgen.rsync, " after read, ", mixgen.wsync, " after write");
+    }
+
+    // Per-thread tables, sized before any thread or worker starts.
+    schedules.resize(max<size_t>(thread_num, 1));
+    breakdown.resize(thread_num);
+    merges.resize(thread_num);
+    WAIT.resize(thread_num);
+
+    Log::log(PROC_MODE ? "process number: " : "thread number: ", thread_num);
+    if (SINGLE_FILE == 2)
+        Log::log(testname[testType], " on single file partitioned into ", thread_num, " regions");
+    else if (SINGLE_FILE)
+        Log::log(testname[testType], " on single file");
+    else
+        Log::log(testname[testType], " on ", file_count(), " file(s) across ", min(file_count(), FILE_DIRS.size()), " dir(s)");
+    if (monitor.enabled())
+        Log::log("run: ", monitor.duration > 0 ? to_string(monitor.duration) + " s" : to_string(IO_ROUND) + " rounds",
+                ", warm-up ", monitor.warmup, " s, steady window ", monitor.window, " x ", monitor.interval, " s, threshold ", monitor.threshold);
+    if (TARGET != "file")
+        Log::log("target: ", TARGET == "memfd" ? "memfd" : "tmpfs in " + TMPFS_DIR, ", O_DIRECT dropped");
+    if (testType == 2)
+        Log::log("STL streams: ", STL_SHARED ? "shared" : "per-thread", ", buffer ",
+                STL_BUF < 0 ? string("default") : STL_BUF ? to_string(STL_BUF) + " B" : string("disabled"));
+    if (!SEED)
+        SEED = time(nullptr);
+    Log::log("seed: ", SEED);
+    if (PAYLOAD.mode != Payload::Const)
+        Log::log("payload: ", PAYLOAD.str());
+    if (ACCESS != "random" || FADVISE != "none" || PREFETCH)
+        Log::log("access: ", ACCESS, STRIDE ? " of " + to_string(STRIDE) + " B" : string(),
+                ", fadvise ", FADVISE, ", readahead ", PREFETCH, " B");
+    if (TX_CHAIN)
+        Log::log(TX_CHAIN == 1 ? "transactions submitted as write/barrier chains"
+                : "transactions written op by op with the barriers of a chain");
+    if (VECTORED)
+        Log::log("vectored: adjacent ops of a batch merged into preadv/pwritev");
+    if (testType == 4)
+        Log::log("LibAIO sync: ", array<const char*, 3>{"blocking fsync", "async fsync", "async fdatasync"}[min<size_t>(AIO_FSYNC, 2)]);
+    if (WAIT.mode != WaitPolicy::Default)
+        Log::log("wait: ", WAIT.str());
+    if (FINAL_SYNC)
+        Log::log("final syncfs of the test directories is timed");
+    Log::log("placement: ", PIN_POLICY, ", ", numa_nodes().size(), " NUMA node(s)", NUMA_LOCAL ? ", node-local buffers" : "");
+}
+
 static void processArgs(int argc, char* argv[])
 {
     using namespace std;
     using namespace tai;
 
-    if (argc < 11)
+    // With a job file the positional arguments may be left out.
+    auto positional = argc > 1 && !strchr(argv[1], '=');
+    if (positional ? argc < 11 : none_of(argv + 1, argv + argc, [](char* a){ return !strncmp(a, "job=", 4); }))
     {
-        cerr << "Need arguments for thread number, type of IO to test and workload type" << endl;
+        cerr << "Need arguments for thread number, type of IO to test and workload type, or job=<file>" << endl;
         exit(-1);
     }
 
     size_t off = 1;
+    if (positional)
+    {
+        [&](vector<size_t*> _){ for (auto i = _.size(); i--; *_[i] = stoll(argv[i + off])); off += _.size(); }({
+                &testType,
+                &workload,
+                &thread_num,
+                &SINGLE_FILE
+                });
+        [&](vector<size_t*> _){ for (auto i = _.size(); i--; *_[i] = 1ll << stoll(argv[i + off])); off += _.size(); }({
+                &FILE_SIZE,
+                });
+        [&](vector<size_t*> _){ for (auto i = _.size(); i--; *_[i] = stoll(argv[i + off]) << 10); off += _.size(); }({
+                &READ_SIZE,
+                &WRITE_SIZE
+                });
+        [&](vector<size_t*> _){ for (auto i = _.size(); i--; *_[i] = 1ll << stoll(argv[i + off])); off += _.size(); }({
+                &IO_ROUND,
+                &SYNC_RATE,
+                &WAIT_RATE
+                });
+    }
+    processOpts(argc, argv, off);
+    settleArgs();
+}
 
-    [&](vector<size_t*> _){ for (auto i = _.size(); i--; *_[i] = stoll(argv[i + off])); off += _.size(); }({
-            &testType,
-            &workload,
-            &thread_num,
-            &SINGLE_FILE
-            });
-    [&](vector<size_t*> _){ for (auto i = _.size(); i--; *_[i] = 1ll << stoll(argv[i + off])); off += _.size(); }({
-            &FILE_SIZE,
-            });
-    [&](vector<size_t*> _){ for (auto i = _.size(); i--; *_[i] = stoll(argv[i + off]) << 10); off += _.size(); }({
-            &READ_SIZE,
-            &WRITE_SIZE
-            });
-    [&](vector<size_t*> _){ for (auto i = _.size(); i--; *_[i] = 1ll << stoll(argv[i + off])); off += _.size(); }({
-            &IO_ROUND,
-            &SYNC_RATE,
-            &WAIT_RATE
+// Moves on to the next phase of the job file, if any.  Its settings go on top
+// of the current ones and are checked and logged as at startup; the backend
+// counters start over.
+static bool next_phase()
+{
+    if (PHASE + 1 >= JOB.phases.size())
+        return false;
+    apply_phase(++PHASE);
+    check_options();
+    settleArgs();
+    breakdown.reset();
+    merges.reset();
+    WAIT.reset();
+    return true;
+}
+
+// The AIO backends keep their control blocks in arrays indexed by tid.
+// Checked again by the parent before it forks workers, so it fails once.
+static void check_backend_threads(int type)
+{
+    using namespace std;
+
+    if ((type == 3 || type == 4) && thread_num > MAX_THREAD_NUM)
+    {
+        cerr << "The AIO backends run at most " << MAX_THREAD_NUM << " threads or procs." << endl;
+        exit(-1);
+    }
+}
+
+// For the drivers that run one phase.
+static void first_phase_only()
+{
+    if (JOB.phases.size() > 1)
+        tai::Log::log("Warning: only the first phase of ", JOB.path, " is run by this driver.");
+}
+
+// Common checks of the drivers that run the first phase on at least
+// min_threads threads, never on processes.
+static void driver_prologue(const char* name, size_t min_threads = 1)
+{
+    using namespace std;
+
+    first_phase_only();
+    if (thread_num < min_threads)
+    {
+        cerr << name << " runs at least " << min_threads << " thread(s)." << endl;
+        exit(-1);
+    }
+    if (PROC_MODE)
+        tai::Log::log("Warning: ", name, " runs threads only, procs ignored.");
+}
+
+// Aborts the driver on a failed system call.
+static void check(long res, const char* what)
+{
+    using namespace std;
+
+    if (res < 0)
+    {
+        cerr << "Error " << errno << ": " << strerror(errno) << " at " << what << "." << endl;
+        exit(-1);
+    }
+}
+
+
+// Pins the calling thread according to PIN_POLICY and records where it runs.
+static void place_thread(size_t tid)
+{
+    using namespace std;
+    using namespace tai;
+
+    placement = Placement();
+    if (PIN_POLICY != "none")
+    {
+        auto order = pin_order(PIN_POLICY);
+        if (order.empty())
+        {
+            cerr << "No CPU for pinning policy \"" << PIN_POLICY << "\"." << endl;
+            exit(-1);
+        }
+        placement.cpu = order[tid % order.size()];
+        if (!pin_thread(placement.cpu))
+            cerr << "Warning: failed to pin thread " << tid << " to cpu " << placement.cpu << "." << endl;
+    }
+    #ifdef __linux__
+    else
+        placement.cpu = sched_getcpu();
+    #endif
+    placement.node = cpu_node(placement.cpu);
+    Log::log("[Thread ", tid, "]", PIN_POLICY == "none" ? "running on" : "pinned to",
+            " cpu ", placement.cpu, ", node ", placement.node);
+}
+
+// Most ops a run keeps outstanding: the async backends queue up to WAIT_RATE per thread.
+TAI_INLINE
+static size_t max_inflight()
+{
+    return thread_num * (testType == 3 || testType == 4 ? WAIT_RATE : 1);
+}
+
+// Time breakdown read by the drivers' summaries, in nanoseconds.
+static long long aio_lockedtime()
+{
+    return breakdown.total(Accounting::Lock);
+}
+
+static long long aio_avg_true_iotime()
+{
+    return breakdown.total(Accounting::IO) / thread_num;
+}
+
+static long long aio_avg_waittime()
+{
+    return breakdown.total(Accounting::Wait) / thread_num;
+}
+
+static void log_accounting()
+{
+    using namespace tai;
+
+    if (!breakdown.enabled)
+        return;
+    for (size_t i = 0; i < thread_num; ++i)
+        Log::log("[Thread ", i, "]", "lock ", breakdown.get(i, Accounting::Lock) / 1e9, " s, io ",
+                breakdown.get(i, Accounting::IO) / 1e9, " s, wait ", breakdown.get(i, Accounting::Wait) / 1e9, " s");
+}
+
+// Files of the run in file_path() order.
+static std::vector<std::string> test_files()
+{
+    std::vector<std::string> files;
+    for (size_t i = 0; i < file_count(); ++i)
+        files.emplace_back(file_path(i));
+    return files;
+}
+
+// With RESIDENCY, logs the page-cache residency of res's files now and
+// at every monitor interval until finish().  In-memory targets are always
+// resident, so they are not scanned.
+static void track_residency(Residency& res)
+{
+    using namespace tai;
+
+    monitor.on_sample = nullptr;
+    if (!RESIDENCY)
+        return;
+    if (TARGET != "file")
+    {
+        Log::log("residency: ", TARGET, " target, not scanned");
+        return;
+    }
+    std::string header = "residency, time(s)";
+    for (auto& f : res.paths())
+        header += ", " + f + "(%)";
+    Log::log(header);
+    res.log("start");
+    monitor.on_sample = [&res](double t){ res.log(std::to_string(t)); };
+}
+
+// Takes usage and the device counters again when the warm-up ends, so they
+// cover the same ops as monitor.ops() and monitor.time().  With forked
+// workers usage keeps the warm-up (see Usage::restart()) and goes with
+// monitor.all_ops().
+static void measure_after_warmup(Usage& usage, DevStat& devstat, DevStat::Snapshot& before)
+{
+    monitor.on_warm = [&usage, &devstat, &before](){
+        usage.restart();
+        before = devstat.snapshot();
+    };
+}
+
+// With FINAL_SYNC, flushes the filesystems of the test directories before
+// the clock stops, so dirty data left by buffered backends is paid for in
+// the measured time instead of by a later sync.
+static void final_sync()
+{
+    using namespace std;
+
+    if (!FINAL_SYNC)
+        return;
+    #ifdef __linux__
+    for (auto& d : FILE_DIRS)
+    {
+        auto fd = open(d.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0 || syncfs(fd))
+        {
+            cerr << "Error " << errno << ": " << strerror(errno) << " at syncfs " << d << "." << endl;
+            exit(-1);
+        }
+        close(fd);
+    }
+    #elif defined(_POSIX_VERSION)
+    sync();
+    #endif
+}
+
+// Forks n worker processes in place of threads (PROC_MODE).  Worker i runs body(i, ready)
+// and calls ready() once set up; start() runs in the parent when all workers are ready,
+// right before they are released together.  Returns when every worker has exited.
+// Workers report ready through one pipe and block on another until the parent closes
+// it; a worker that dies before it is ready aborts the run instead of hanging it.
+template<typename Start, typename Body>
+static void fork_workers(size_t n, Start start, Body body)
+{
+    using namespace std;
+
+    #ifdef __linux__
+    int ready[2], go[2];
+    if (pipe(ready) || pipe(go))
+    {
+        cerr << "Error " << errno << ": " << strerror(errno) << " at pipe." << endl;
+        exit(-1);
+    }
+
+    vector<pid_t> pids;
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto pid = fork();
+        if (pid < 0)
+        {
+            cerr << "Error " << errno << ": " << strerror(errno) << " at fork." << endl;
+            exit(-1);
+        }
+        if (!pid)
+        {
+            close(ready[0]);
+            close(go[1]);
+            body(i, [&](){
+                char c = 0;
+                if (write(ready[1], &c, 1) != 1 || read(go[0], &c, 1))
+                    _exit(1);
             });
+            _exit(0);
+        }
+        pids.emplace_back(pid);
+    }
+    close(ready[1]);
+    close(go[0]);
+
+    for (size_t got = 0; got < n; )
+    {
+        pollfd pfd = {ready[0], POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0)
+        {
+            char buf[64];
+            auto r = read(ready[0], buf, sizeof(buf));
+            got += r > 0 ? r : 0;
+            if (r > 0)
+                continue;
+        }
+        int status;
+        if (waitpid(-1, &status, WNOHANG) > 0)
+        {
+            for (auto pid : pids)
+                kill(pid, SIGKILL);
+            while (wait(nullptr) > 0)
+                ;
+            cerr << "A worker process died before it was ready." << endl;
+            exit(-1);
+        }
+    }
+    close(ready[0]);
+    start();
+    close(go[1]);   // EOF releases every worker at once
 
-    Log::log("thread number: ", thread_num);
-    Log::log(testname[testType], " on ", SINGLE_FILE ? "single file" : "multiple files");
+    auto failed = false;
+    for (auto pid : pids)
+    {
+        int status;
+        waitpid(pid, &status, 0);
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status);
+    }
+    if (failed)
+    {
+        cerr << "A worker process failed." << endl;
+        exit(-1);
+    }
+    #else
+    cerr << "Multi-process mode needs Linux." << endl;
+    exit(-1);
+    #endif
+}
+
+// Loop condition of the drivers: IO_ROUND rounds (unbounded for time-based runs) until the
+// monitor stops the run.  Runs only stop on a WAIT_RATE boundary so the batches stay intact.
+TAI_INLINE
+static bool keep_running(size_t i)
+{
+    return (monitor.duration > 0 || i < IO_ROUND) && ((i & ~-WAIT_RATE) || !monitor.stopped());
 }
 
+// I/O buffers, allocated on the thread's node when NUMA_LOCAL is set.
 TAI_INLINE
-static auto randgen(size_t align = 0)
+static char* alloc_buffer(size_t size)
 {
-    static const auto size = FILE_SIZE - (READ_SIZE > WRITE_SIZE ? READ_SIZE : WRITE_SIZE) + 1;
-    return rand() % size & -align;
+    return NUMA_LOCAL ? alloc_local(size, placement.node) : new char[size];
+}
+
+TAI_INLINE
+static void free_buffer(char* buf, size_t size)
+{
+    if (NUMA_LOCAL)
+        free_local(buf, size);
+    else
+        delete[] buf;
+}
+
+// Applies FADVISE to a freshly opened fd.  seq/random only affect this
+// open file's readahead; willneed/dontneed/noreuse act on the file's pages.
+static int advise(int fd)
+{
+    using namespace std;
+
+    #ifdef POSIX_FADV_NORMAL
+    static const map<string, int> advice = {
+        {"normal", POSIX_FADV_NORMAL},
+        {"seq", POSIX_FADV_SEQUENTIAL},
+        {"random", POSIX_FADV_RANDOM},
+        {"willneed", POSIX_FADV_WILLNEED},
+        {"dontneed", POSIX_FADV_DONTNEED},
+        {"noreuse", POSIX_FADV_NOREUSE}
+    };
+    if (fd < 0 || FADVISE == "none")
+        return fd;
+    auto it = advice.find(FADVISE);
+    if (it == advice.end())
+    {
+        cerr << "Unknown fadvise hint \"" << FADVISE << "\"." << endl;
+        exit(-1);
+    }
+    if (auto err = posix_fadvise(fd, 0, 0, it->second))
+        cerr << "Warning " << err << ": " << strerror(err) << " at posix_fadvise." << endl;
+    #endif
+    return fd;
 }
 
+// One step of a transaction chain: a write, or a barrier that makes every
+// earlier write of the chain durable before any later one is issued.
+struct TxOp
+{
+    bool barrier;
+    off_t offset;
+    char* data;
+    size_t size;
+};
+
 class RandomWrite
 {
 public:
@@ -106,6 +785,8 @@ public:
     int openflags;
     std::atomic<size_t> opencnt = {0};
     std::atomic<bool> opened = {false};
+    std::mutex openMtx;     // orders the first open against the last close
+    std::vector<off_t> ra_end;  // end of the last readahead window by tid, sized at open
 
     RandomWrite()
     {
@@ -129,14 +810,12 @@ public:
     {
         using namespace std;
 
+        lock_guard<mutex> lck(openMtx);
         if (opencnt.fetch_add(1))
-        {
-            while (!opened.load());
             return;
-        }
 
         #ifdef _POSIX_VERSION
-        fd = open(filename.c_str(), openflags);
+        fd = open_target(filename);
         #else
         cerr << "RandomWrite::openfile() needs POSIX support." << endl;
         #endif
@@ -150,21 +829,39 @@ public:
 
         syncop();
         cleanup();
+        lock_guard<mutex> lck(openMtx);
         if (opencnt.fetch_sub(1) - 1)
             return;
 
         #ifdef _POSIX_VERSION
         close(fd);
         fd = -1;
+        close_target();
         #else
         cerr << "RandomWrite::closefile() needs POSIX support." << endl;
         #endif
     }
 
-    virtual void writeop(off_t offset, char* data) = 0;
-    virtual void readop(off_t offset, char* data) = 0;
+    virtual void writeop(off_t offset, char* data, size_t size = WRITE_SIZE) = 0;
+    virtual void readop(off_t offset, char* data, size_t size = READ_SIZE) = 0;
     virtual void syncop() = 0;
 
+    // Vectored ops on a contiguous range starting at offset; one op per
+    // segment unless the backend has a vectored call.
+    TAI_INLINE
+    virtual void writevop(off_t offset, const iovec* iov, int cnt)
+    {
+        for (int i = 0; i < cnt; offset += iov[i++].iov_len)
+            writeop(offset, (char*)iov[i].iov_base, iov[i].iov_len);
+    }
+
+    TAI_INLINE
+    virtual void readvop(off_t offset, const iovec* iov, int cnt)
+    {
+        for (int i = 0; i < cnt; offset += iov[i++].iov_len)
+            readop(offset, (char*)iov[i].iov_base, iov[i].iov_len);
+    }
+
     TAI_INLINE
     virtual void osync() { syncop(); }
 
@@ -183,10 +880,204 @@ public:
     TAI_INLINE
     virtual void cleanup() {}
 
+    // Submits a transaction chain as one unit and returns once its last
+    // barrier completed; writes after that barrier are left in flight as with
+    // writeop().  Emulated with one call per step, backends that can hand a
+    // whole segment of writes to the kernel at once override it.
+    TAI_INLINE
+    virtual void txchain(const std::vector<TxOp>& chain)
+    {
+        for (auto& op : chain)
+            if (op.barrier)
+                barrier();
+            else
+                writeop(op.offset, op.data, op.size);
+    }
+
+    // Makes every write issued so far durable before it returns.
+    TAI_INLINE
+    virtual void barrier()
+    {
+        syncop();
+        wait_cb();
+    }
+
+    // Explicit readahead() of the PREFETCH bytes after a read, issued when
+    // the read leaves the lower half of the last window.  Goes to the page
+    // cache whatever the backend, so it only helps buffered readers.
+    TAI_INLINE
+    void prefetch(off_t offset, size_t size)
+    {
+        #ifdef __linux__
+        // No file, as with NullWrite, means no windows either.
+        if (!PREFETCH || fd < 0)
+            return;
+        auto end = offset + (off_t)size;
+        auto& ra = ra_end[tid];
+        if (end > ra - (off_t)PREFETCH / 2 || end < ra - (off_t)PREFETCH)
+        {
+            readahead(fd, end, PREFETCH);
+            ra = end + PREFETCH;
+        }
+        #endif
+    }
+
     static std::unique_ptr<RandomWrite> getInstance(int testType, bool concurrent = false);
     static thread_local ssize_t tid;
+
+protected:
+    // Path of the opened file; for in-memory targets, the memfd or tmpfs file standing in for it.
+    std::string path;
+
+    TAI_INLINE
+    int target_flags() const
+    {
+        #ifdef __linux__
+        if (TARGET != "file")
+            return openflags & ~O_DIRECT;
+        #endif
+        return openflags;
+    }
+
+    // Opens the test file, or its in-memory stand-in of FILE_SIZE bytes for TARGET memfd/tmpfs.
+    int open_target(const std::string& filename)
+    {
+        using namespace std;
+
+        path = filename;
+        ra_end.assign(thread_num, 0);
+        if (TARGET == "file")
+            return advise(open(filename.c_str(), openflags));
+
+        int fd = -1;
+        #ifdef __linux__
+        if (TARGET == "memfd")
+        {
+            fd = memfd_create(filename.c_str(), 0);
+            path = "/proc/self/fd/" + to_string(fd);
+        }
+        else
+        {
+            path = TMPFS_DIR + "/iotest-" + filename.substr(filename.rfind('/') + 1);
+            fd = open(path.c_str(), target_flags() | O_CREAT, 0644);
+        }
+        if (fd < 0 || ftruncate(fd, FILE_SIZE))
+        {
+            cerr << "Error " << errno << ": " << strerror(errno) << " at opening " << TARGET << " target." << endl;
+            exit(-1);
+        }
+        #else
+        cerr << "In-memory targets need Linux." << endl;
+        exit(-1);
+        #endif
+        return advise(fd);
+    }
+
+    TAI_INLINE
+    void close_target()
+    {
+        if (TARGET == "tmpfs")
+            unlink(path.c_str());
+    }
+};
+
+TAI_INLINE
+static auto randgen(XorShift& rng, size_t tid, size_t align = 0)
+{
+    // Recomputed per call: job phases may change the sizes and thread count.
+    auto blk = READ_SIZE > WRITE_SIZE ? READ_SIZE : WRITE_SIZE;
+    auto region = SINGLE_FILE == 2 ? FILE_SIZE / thread_num / blk * blk : FILE_SIZE;
+    return (SINGLE_FILE == 2 ? region * tid : 0) + (rng() % (region - blk + 1) & -align);
+}
+
+// Independent streams of one thread.  Each has a salt of its own: offsetting
+// tid instead would run into the streams of other threads.
+enum RngStream : uint64_t { OpStream, PayloadStream, LinkStream };
+
+// Generator of thread (or worker process) tid, derived from SEED only.
+TAI_INLINE
+static XorShift thread_rng(size_t tid, RngStream stream = OpStream)
+{
+    // Every job phase draws new offsets; the first one those of a plain run.
+    return XorShift(SEED ^ (tid + 1) * 0x9e3779b97f4a7c15ull ^ PHASE * 0xbf58476d1ce4e5b9ull ^
+            stream * 0x94d049bb133111ebull);
+}
+
+// Separate stream for buffer contents, so PAYLOAD does not shift the offsets.
+static XorShift payload_rng(size_t tid)
+{
+    return thread_rng(tid, PayloadStream);
+}
+
+// Part of its file that thread tid works on, as (base, len) with len a
+// multiple of blk: threads sharing a file get disjoint parts.
+static std::pair<off_t, size_t> part_of(size_t tid, size_t blk)
+{
+    auto parts = (thread_num + file_count() - 1) / file_count();
+    auto len = FILE_SIZE / parts / blk * blk;
+    return {(off_t)(len * (tid / file_count())), len};
+}
+
+// Offsets of thread tid per ACCESS: uniformly random, or a sequential or
+// strided stream over the thread's part of its file.  Threads sharing a file
+// get disjoint parts.  A strided stream that reaches the end starts over one
+// block further, so later passes visit the blocks skipped before.
+class OffsetGen
+{
+    XorShift& rng;
+    size_t tid;
+    size_t base = 0, len = 0, cursor = 0, lane = 0;
+
+public:
+    OffsetGen(XorShift& rng, size_t tid) : rng(rng), tid(tid)
+    {
+        auto part = part_of(tid, READ_SIZE > WRITE_SIZE ? READ_SIZE : WRITE_SIZE);
+        base = part.first;
+        len = part.second;
+    }
+
+    TAI_INLINE
+    size_t operator()(size_t size, size_t align)
+    {
+        if (ACCESS == "random")
+            return randgen(rng, tid, align);
+        auto step = ACCESS == "stride" && STRIDE > size ? STRIDE : size;
+        if (cursor + size > len)
+            cursor = lane = step > size ? (lane + size) % step : 0;
+        auto off = base + cursor;
+        cursor += step;
+        return off;
+    }
+};
+
+// Generator state of a schedule, kept for its passes after the first.
+struct PlanState
+{
+    XorShift rng;
+    OffsetGen offgen;
+
+    PlanState(size_t tid) : rng(thread_rng(tid)), offgen(rng, tid) {}
 };
 
+// Schedule of thread tid: n ops of one type and size.
+static void plan(size_t tid, size_t n, bool read, size_t size)
+{
+    auto st = std::make_shared<PlanState>(tid);
+    schedules[tid].generate(n, [st, read, size](Schedule::Op& op){
+        op = {st->offgen(size, size), (uint32_t)size, read, 0};
+    });
+}
+
+// Schedule of thread tid: n ops drawn from mixgen.
+static void plan_mixed(size_t tid, size_t n)
+{
+    auto st = std::make_shared<PlanState>(tid);
+    schedules[tid].generate(n, [st](Schedule::Op& op){
+        auto m = mixgen(st->rng);
+        op = {st->offgen(m.size, m.size & -m.size), (uint32_t)m.size, m.read, m.sync};
+    });
+}
+
 class BlockingWrite : public RandomWrite
 {
 public: 
@@ -196,12 +1087,13 @@ public:
     }
 
     TAI_INLINE
-    virtual void writeop(off_t offset, char* data) override
+    virtual void writeop(off_t offset, char* data, size_t size = WRITE_SIZE) override
     {
         using namespace std;
 
         #ifdef _POSIX_VERSION
-        if (pwrite(fd, data, WRITE_SIZE, offset) < 0)
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
+        if (pwrite(fd, data, size, offset) < 0)
         {
             cerr << "Error " << errno << ": " << strerror(errno) << " at pwrite." << endl;
             exit(-1);
@@ -212,12 +1104,13 @@ public:
     }
 
     TAI_INLINE
-    virtual void readop(off_t offset, char* data) override
+    virtual void readop(off_t offset, char* data, size_t size = READ_SIZE) override
     {
         using namespace std;
 
         #ifdef _POSIX_VERSION
-        if (pread(fd, data, READ_SIZE, offset) < 0)
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
+        if (pread(fd, data, size, offset) < 0)
         {
             cerr << "Error " << errno << ": " << strerror(errno) << " at pread." << endl;
             exit(-1);
@@ -227,12 +1120,47 @@ public:
         #endif
     }
 
+    TAI_INLINE
+    virtual void writevop(off_t offset, const iovec* iov, int cnt) override
+    {
+        using namespace std;
+
+        #ifdef _POSIX_VERSION
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
+        if (pwritev(fd, iov, cnt, offset) < 0)
+        {
+            cerr << "Error " << errno << ": " << strerror(errno) << " at pwritev." << endl;
+            exit(-1);
+        }
+        #else
+        cerr << "Warning: BlockingWrite needs POSIX support." << endl;
+        #endif
+    }
+
+    TAI_INLINE
+    virtual void readvop(off_t offset, const iovec* iov, int cnt) override
+    {
+        using namespace std;
+
+        #ifdef _POSIX_VERSION
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
+        if (preadv(fd, iov, cnt, offset) < 0)
+        {
+            cerr << "Error " << errno << ": " << strerror(errno) << " at preadv." << endl;
+            exit(-1);
+        }
+        #else
+        cerr << "Warning: BlockingWrite needs POSIX support." << endl;
+        #endif
+    }
+
     TAI_INLINE
     virtual void syncop() override
     {
         using namespace std;
 
         #ifdef _POSIX_VERSION
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
         if (fsync(fd))
         {
             cerr << "Error " << errno << ": " << strerror(errno) << " at fsync." << endl;
@@ -244,43 +1172,125 @@ public:
     }
 };
 
+// In concurrent mode every thread gets its own fstream and fsync fd on the shared file,
+// unless STL_SHARED asks for the old single stream behind a mutex.  Each thread
+// flushes, syncs and closes its own stream when it closes the file.
+// STL_BUF sets the stream buffer size: -1 for the library default, 0 for unbuffered.
 template <bool concurrent = false>
 class FstreamWrite : public BlockingWrite
 {
     std::fstream file;
     std::mutex mtx;
+    std::unique_ptr<char[]> buf;
+
+    struct Stream
+    {
+        std::fstream file;
+        std::unique_ptr<char[]> buf;
+        int fd = -1;
+    };
+    std::vector<Stream> streams;    // by tid, one per thread of the run, built by the first openfile()
+
+    TAI_INLINE
+    static bool shared()
+    {
+        return !concurrent || STL_SHARED;
+    }
+
+    // pubsetbuf only takes effect before the stream is opened.
+    TAI_INLINE
+    static void open_stream(std::fstream& f, std::unique_ptr<char[]>& b, const std::string& name)
+    {
+        using namespace std;
+
+        if (f.is_open())
+            f.close();
+        if (STL_BUF == 0)
+            f.rdbuf()->pubsetbuf(nullptr, 0);
+        else if (STL_BUF > 0)
+        {
+            b.reset(new char[STL_BUF]);
+            f.rdbuf()->pubsetbuf(b.get(), STL_BUF);
+        }
+        f.open(name, ios::binary | ios::in | ios::out);
+    }
+
+    // Stream of the calling thread, opened on first use.
+    TAI_INLINE
+    std::fstream& stream()
+    {
+        if (shared())
+            return file;
+        auto& s = streams[tid];
+        if (unlikely(!s.file.is_open()))
+        {
+            #ifdef _POSIX_VERSION
+            s.fd = open(path.c_str(), target_flags());
+            #endif
+            open_stream(s.file, s.buf, path);
+        }
+        return s.file;
+    }
 
 public: 
+
     TAI_INLINE
-    FstreamWrite()
+    virtual void writeop(off_t offset, char* data, size_t size = WRITE_SIZE) override
     {
+        using namespace std;
+
+        Accounting::HeldLock<mutex> lck(breakdown, tid, mtx);
+        if (concurrent && STL_SHARED)
+            lck.lock();
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
+        stream().seekp(offset).write(data, size);
     }
 
     TAI_INLINE
-    virtual void writeop(off_t offset, char* data) override
+    virtual void readop(off_t offset, char* data, size_t size = READ_SIZE) override
     {
-        if (concurrent)
-            mtx.lock();
-        file.seekp(offset).write(data, WRITE_SIZE);
-        if (concurrent)
-            mtx.unlock();
+        using namespace std;
+
+        Accounting::HeldLock<mutex> lck(breakdown, tid, mtx);
+        if (concurrent && STL_SHARED)
+            lck.lock();
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
+        stream().seekg(offset).read(data, size);
     }
 
+    // Through the stream, not pwritev()/preadv() on the fd underneath.
     TAI_INLINE
-    virtual void readop(off_t offset, char* data) override
+    virtual void writevop(off_t offset, const iovec* iov, int cnt) override
     {
-        if (concurrent)
-            mtx.lock();
-        file.seekg(offset).read(data, READ_SIZE);
-        if (concurrent)
-            mtx.unlock();
+        RandomWrite::writevop(offset, iov, cnt);
+    }
+
+    TAI_INLINE
+    virtual void readvop(off_t offset, const iovec* iov, int cnt) override
+    {
+        RandomWrite::readvop(offset, iov, cnt);
     }
 
     TAI_INLINE
     virtual void syncop() override
     {
-        file.flush();
-        BlockingWrite::syncop();
+        using namespace std;
+
+        Accounting::HeldLock<mutex> lck(breakdown, tid, mtx);
+        if (concurrent && STL_SHARED)
+            lck.lock();
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
+        stream().flush();
+        if (concurrent && STL_SHARED)
+            lck.unlock();
+
+        #ifdef _POSIX_VERSION
+        if (fsync(shared() ? fd : streams[tid].fd))
+        {
+            cerr << "Error " << errno << ": " << strerror(errno) << " at fsync." << endl;
+            exit(-1);
+        }
+        #endif
     }
 
     TAI_INLINE
@@ -288,36 +1298,72 @@ public:
     {
         using namespace std;
 
+        lock_guard<mutex> lck(openMtx);
         if (opencnt.fetch_add(1))
-        {
-            while (!opened.load());
             return;
-        }
 
         #ifdef _POSIX_VERSION
-        fd = open(filename.c_str(), openflags); // fd for fsync
+        fd = open_target(filename); // fd for fsync
         #endif
 
-        if (file.is_open())
-            file.close();
-        file.open(filename, ios::binary | ios::in | ios::out);
+        if (shared())
+            open_stream(file, buf, path);
+        else
+            streams = std::vector<Stream>(thread_num);
         opened.store(true);
     }
 
     virtual void closefile() override
     {
+        using namespace std;
+
+        if (!shared() && streams[tid].file.is_open())
+        {
+            syncop();
+            streams[tid].file.close();
+            #ifdef _POSIX_VERSION
+            close(streams[tid].fd);
+            #endif
+        }
+
+        lock_guard<mutex> lck(openMtx);
         if (opencnt.fetch_sub(1) - 1)
             return;
 
-        syncop();
-        file.close();
+        if (shared())
+        {
+            syncop();
+            file.close();
+        }
+        streams.clear();
 
         #ifdef _POSIX_VERSION
         close(fd);
+        close_target();
         #endif
     }
 };
 
+// No-op sink: the harness cost without any file at all.
+class NullWrite : public RandomWrite
+{
+public:
+    TAI_INLINE
+    virtual void openfile(const std::string& filename) override {}
+
+    TAI_INLINE
+    virtual void closefile() override {}
+
+    TAI_INLINE
+    virtual void writeop(off_t offset, char* data, size_t size = WRITE_SIZE) override {}
+
+    TAI_INLINE
+    virtual void readop(off_t offset, char* data, size_t size = READ_SIZE) override {}
+
+    TAI_INLINE
+    virtual void syncop() override {}
+};
+
 class AIOWrite : public RandomWrite
 {
     #ifdef _POSIX_VERSION
@@ -356,12 +1402,19 @@ public:
         using namespace chrono_literals;
 
         #ifdef _POSIX_VERSION
+        Accounting::Scope wait(breakdown, tid, Accounting::Wait);
         for (auto &i : cbs[tid])
         {
             int err;
-            for (; (err = aio_error(&i)) == EINPROGRESS;)
-                if (!busy)
-                    this_thread::sleep_for(1ms);
+            if (WAIT.mode != WaitPolicy::Default)
+                WAIT.wait(tid, [&](){ return (err = aio_error(&i)) != EINPROGRESS; }, [&](){
+                    const aiocb* list[] = {&i};
+                    for (; (err = aio_error(&i)) == EINPROGRESS; aio_suspend(list, 1, nullptr));
+                });
+            else
+                for (; (err = aio_error(&i)) == EINPROGRESS;)
+                    if (!busy)
+                        this_thread::sleep_for(1ms);
             if (unlikely(err))
             {
                 cerr << err <<  " Error " << errno << ": " << strerror(errno) << " at aio_error." << endl;
@@ -397,7 +1450,7 @@ public:
 
 
     TAI_INLINE
-    virtual void writeop(off_t offset, char* data) override
+    virtual void writeop(off_t offset, char* data, size_t size = WRITE_SIZE) override
     {
         using namespace std;
 
@@ -406,9 +1459,10 @@ public:
         auto& cb = cbs[tid].back(); 
         memset(&cb, 0, sizeof(cb));
         cb.aio_fildes = fd;
-        cb.aio_nbytes = WRITE_SIZE;
+        cb.aio_nbytes = size;
         cb.aio_buf = data;
         cb.aio_offset = offset;
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
         if (aio_write(&cb))
         {
             cerr << "Error " << errno << ": " << strerror(errno) << " at aio_write." << endl;
@@ -420,7 +1474,7 @@ public:
     }
 
     TAI_INLINE
-    virtual void readop(off_t offset, char* data) override
+    virtual void readop(off_t offset, char* data, size_t size = READ_SIZE) override
     {
         using namespace std;
 
@@ -429,9 +1483,10 @@ public:
         auto& cb = cbs[tid].back();
         memset(&cb, 0, sizeof(cb));
         cb.aio_fildes = fd;
-        cb.aio_nbytes = READ_SIZE;
+        cb.aio_nbytes = size;
         cb.aio_buf = data;
         cb.aio_offset = offset;
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
         if (aio_read(&cb))
         {
             cerr << "Error " << errno << ": " << strerror(errno) << " at aio_read." << endl;
@@ -453,6 +1508,7 @@ public:
         auto& cb = cbs[tid].back();
         memset(&cb, 0, sizeof(cb));
         cb.aio_fildes = fd;
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
         if (aio_fsync(O_SYNC, &cb))
         {
             cerr << "Error " << errno << ": " << strerror(errno) << " at aio_fsync." << endl;
@@ -463,6 +1519,52 @@ public:
         #endif
     }
 
+    // Each segment of writes goes out in one lio_listio() with the aio_fsync
+    // queued right behind it (POSIX has the fsync cover every op queued
+    // before it); the barrier then waits for the segment and its fsync.
+    TAI_INLINE
+    virtual void txchain(const std::vector<TxOp>& chain) override
+    {
+        using namespace std;
+
+        #ifdef _POSIX_VERSION
+        vector<aiocb*> list;
+        auto first = cbs[tid].size();
+        auto submit = [&](){
+            list.clear();
+            for (auto i = first; i < cbs[tid].size(); ++i)
+                list.emplace_back(&cbs[tid][i]);
+            Accounting::Scope io(breakdown, tid, Accounting::IO);
+            if (!list.empty() && lio_listio(LIO_NOWAIT, list.data(), list.size(), nullptr))
+            {
+                cerr << "Error " << errno << ": " << strerror(errno) << " at lio_listio." << endl;
+                exit(-1);
+            }
+        };
+        for (auto& op : chain)
+        {
+            if (!op.barrier)
+            {
+                cbs[tid].emplace_back();
+                auto& cb = cbs[tid].back();
+                memset(&cb, 0, sizeof(cb));
+                cb.aio_fildes = fd;
+                cb.aio_lio_opcode = LIO_WRITE;
+                cb.aio_nbytes = op.size;
+                cb.aio_buf = op.data;
+                cb.aio_offset = op.offset;
+                continue;
+            }
+            submit();
+            barrier();
+            first = cbs[tid].size();
+        }
+        submit();
+        #else
+        RandomWrite::txchain(chain);
+        #endif
+    }
+
 };
 
 template <bool concurrent = false>
@@ -474,7 +1576,49 @@ class LibAIOWrite : public RandomWrite
     io_context_t io_cxt;
     #endif
     std::mutex cntMtx;
-    int cnt;
+    int cnt = 0;
+
+    // Reaps the cnt outstanding iocbs; only failed syncs are reported,
+    // as before for reads and writes.
+    TAI_INLINE
+    void reap()
+    {
+        using namespace std;
+
+        #ifdef __linux__
+        Accounting::Scope wait(breakdown, tid, Accounting::Wait);
+        int n = 0;
+        // Collects whatever has completed; with a zero timeout it never blocks.
+        auto getevents = [&](long min, timespec* timeout){
+            auto got = io_getevents(io_cxt, min, cnt - n, events[tid] + n, timeout);
+            if (got < 0)
+            {
+                cerr << "LibAIO Error " << -got << ": " << strerror(-got) << " at io_getevents." << endl;
+                exit(-1);
+            }
+            return n += got;
+        };
+        if (WAIT.mode == WaitPolicy::Default)
+            getevents(cnt, nullptr);
+        else
+            WAIT.wait(tid, [&](){ timespec zero = {0, 0}; return n == cnt || getevents(0, &zero) == cnt; },
+                    [&](){ getevents(cnt - n, nullptr); });
+        for (int i = 0; i < n; ++i)
+        {
+            // Syncs are tagged in data: in concurrent mode the iocb may be
+            // another thread's, already freed by its reset_cb().
+            auto& ev = events[tid][i];
+            auto op = (uintptr_t)ev.data;
+            if ((op == IO_CMD_FSYNC || op == IO_CMD_FDSYNC) && (long)ev.res < 0)
+            {
+                cerr << "LibAIO Error " << -(long)ev.res << ": " << strerror(-(long)ev.res) << " at fsync." << endl;
+                exit(-1);
+            }
+        }
+        #endif
+        cnt = 0;
+    }
+
 public:
     TAI_INLINE
     LibAIOWrite()
@@ -514,29 +1658,20 @@ public:
     {
         using namespace std;
 
-        unique_lock<mutex> lck(cntMtx, std::defer_lock);
+        Accounting::HeldLock<mutex> lck(breakdown, tid, cntMtx);
         if (concurrent)
             lck.lock();
         #ifdef __linux__
-        io_getevents(io_cxt, cnt, cnt, events[tid], nullptr);
+        reap();
         #else
         cerr << "Warning: LibAIO is not supported on non-Linux system." << endl;
         #endif
-
-        #ifdef _POSIX_VERSION
-        if (fsync(fd))
-        {
-            cerr << "LibAIO Error " << errno << ": " << strerror(errno) << " at fsync." << endl;
-            exit(-1);
-        }
-        #endif
-        cnt = 0;
         if (concurrent)
             lck.unlock();
         reset_cb();
     }
 
-    // No way to busy wait.
+    // Busy waiting needs a wait policy (wait=spin).
     TAI_INLINE
     virtual void busywait_cb() override
     {
@@ -544,17 +1679,18 @@ public:
     }
 
     TAI_INLINE
-    virtual void writeop(off_t offset, char* data) override
+    virtual void writeop(off_t offset, char* data, size_t size = WRITE_SIZE) override
     {
         using namespace std;
 
-        unique_lock<mutex> lck(cntMtx, std::defer_lock);
+        Accounting::HeldLock<mutex> lck(breakdown, tid, cntMtx);
         if (concurrent)
             lck.lock();
         #ifdef __linux__
         cbs[tid].emplace_back(new iocb);
         auto& cb = cbs[tid].back();
-        io_prep_pwrite(cb, fd, data, WRITE_SIZE, offset);
+        io_prep_pwrite(cb, fd, data, size, offset);
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
         auto err = io_submit(io_cxt, 1, &cb);
         if (err < 1)
         {
@@ -568,17 +1704,18 @@ public:
     }
 
     TAI_INLINE
-    virtual void readop(off_t offset, char* data) override
+    virtual void readop(off_t offset, char* data, size_t size = READ_SIZE) override
     {
         using namespace std;
 
-        unique_lock<mutex> lck(cntMtx, std::defer_lock);
+        Accounting::HeldLock<mutex> lck(breakdown, tid, cntMtx);
         if (concurrent)
             lck.lock();
         #ifdef __linux__
         cbs[tid].emplace_back(new iocb);
         auto& cb = cbs[tid].back();
-        io_prep_pread(cb, fd, data, READ_SIZE, offset);
+        io_prep_pread(cb, fd, data, size, offset);
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
         auto err = io_submit(io_cxt, 1, &cb);
         if (err < 1)
         {
@@ -591,21 +1728,108 @@ public:
         ++cnt;
     }
 
+    // The kernel copies the iovec array in io_submit(), so it need not
+    // outlive the call; the buffers do.
+    TAI_INLINE
+    virtual void writevop(off_t offset, const iovec* iov, int n) override
+    {
+        using namespace std;
+
+        Accounting::HeldLock<mutex> lck(breakdown, tid, cntMtx);
+        if (concurrent)
+            lck.lock();
+        #ifdef __linux__
+        cbs[tid].emplace_back(new iocb);
+        auto& cb = cbs[tid].back();
+        io_prep_pwritev(cb, fd, iov, n, offset);
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
+        auto err = io_submit(io_cxt, 1, &cb);
+        if (err < 1)
+        {
+            cerr << "Error " << -err << ": " << strerror(-err) << " at libaio: writev." << endl;
+            exit(-1);
+        }
+        #else
+        cerr << "Warning: LibAIO is not supported on non-Linux system." << endl;
+        #endif
+        ++cnt;
+    }
+
+    TAI_INLINE
+    virtual void readvop(off_t offset, const iovec* iov, int n) override
+    {
+        using namespace std;
+
+        Accounting::HeldLock<mutex> lck(breakdown, tid, cntMtx);
+        if (concurrent)
+            lck.lock();
+        #ifdef __linux__
+        cbs[tid].emplace_back(new iocb);
+        auto& cb = cbs[tid].back();
+        io_prep_preadv(cb, fd, iov, n, offset);
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
+        auto err = io_submit(io_cxt, 1, &cb);
+        if (err < 1)
+        {
+            cerr << "Error " << -err << ": " << strerror(-err) << " at libaio: readv." << endl;
+            exit(-1);
+        }
+        #else
+        cerr << "Warning: LibAIO is not supported on non-Linux system." << endl;
+        #endif
+        ++cnt;
+    }
+
+    // AIO_FSYNC 0: reap the outstanding ops, then one blocking fsync.
+    // AIO_FSYNC 1/2: submit an fsync/fdatasync iocb through the same context,
+    // right behind the ops in flight, and return; it is reaped with them by
+    // the next wait_cb().  The kernel does not order an aio fsync after writes
+    // still in flight: it covers the writes that completed before it ran.  A
+    // write is durable once it has been reaped and a sync submitted after
+    // that has been reaped too; barrier() does exactly that.
     TAI_INLINE
     virtual void syncop() override
     {
         using namespace std;
 
-        wait_cb();
+        if (!AIO_FSYNC)
+        {
+            wait_cb();
 
-        #ifdef _POSIX_VERSION
-        if (fsync(fd))
+            #ifdef _POSIX_VERSION
+            Accounting::Scope io(breakdown, tid, Accounting::IO);
+            if (fsync(fd))
+            {
+                cerr << "Error " << errno << ": " << strerror(errno) << " at fsync." << endl;
+                exit(-1);
+            }
+            #else
+            cerr << "Warning: LibAIOWrite needs POSIX support." << endl;
+            #endif
+            return;
+        }
+
+        Accounting::HeldLock<mutex> lck(breakdown, tid, cntMtx);
+        if (concurrent)
+            lck.lock();
+        #ifdef __linux__
+        cbs[tid].emplace_back(new iocb);
+        auto& cb = cbs[tid].back();
+        if (AIO_FSYNC == 1)
+            io_prep_fsync(cb, fd);
+        else
+            io_prep_fdsync(cb, fd);
+        cb->data = (void*)(uintptr_t)cb->aio_lio_opcode;
+        Accounting::Scope io(breakdown, tid, Accounting::IO);
+        auto err = io_submit(io_cxt, 1, &cb);
+        if (err < 1)
         {
-            cerr << "Error " << errno << ": " << strerror(errno) << " at fsync." << endl;
+            cerr << "Error " << -err << ": " << strerror(-err) << " at libaio: fsync." << endl;
             exit(-1);
         }
+        ++cnt;
         #else
-        cerr << "Warning: LibAIOWrite needs POSIX support." << endl;
+        cerr << "Warning: LibAIO is not supported on non-Linux system." << endl;
         #endif
     }
 
@@ -615,8 +1839,131 @@ public:
         wait_cb();
     }
 
+    // With an async sync the writes in flight are reaped first, as it only
+    // covers completed writes.
+    TAI_INLINE
+    virtual void barrier() override
+    {
+        if (AIO_FSYNC)
+            wait_cb();
+        syncop();
+        wait_cb();
+    }
+
+    // Each segment of writes goes out in one io_submit().  Linux AIO has no
+    // linked submissions and its fsync only covers completed writes, so a
+    // barrier still reaps the segment before it syncs.
+    TAI_INLINE
+    virtual void txchain(const std::vector<TxOp>& chain) override
+    {
+        using namespace std;
+
+        #ifdef __linux__
+        vector<iocb*> seg;
+        auto submit = [&](){
+            Accounting::HeldLock<mutex> lck(breakdown, tid, cntMtx);
+            if (concurrent)
+                lck.lock();
+            Accounting::Scope io(breakdown, tid, Accounting::IO);
+            for (size_t done = 0; done < seg.size(); )
+            {
+                auto err = io_submit(io_cxt, seg.size() - done, seg.data() + done);
+                if (err < 1)
+                {
+                    cerr << "Error " << -err << ": " << strerror(-err) << " at libaio: write." << endl;
+                    exit(-1);
+                }
+                done += err;
+            }
+            cnt += seg.size();
+            seg.clear();
+        };
+        for (auto& op : chain)
+        {
+            if (!op.barrier)
+            {
+                cbs[tid].emplace_back(new iocb);
+                io_prep_pwrite(cbs[tid].back(), fd, op.data, op.size, op.offset);
+                seg.emplace_back(cbs[tid].back());
+                continue;
+            }
+            submit();
+            barrier();
+        }
+        submit();
+        #else
+        RandomWrite::txchain(chain);
+        #endif
+    }
+
+};
+
+// Collects the reads or the writes of a batch and issues them sorted by
+// offset, each run of adjacent blocks as one vectored call.  The sort is
+// stable, so writes to the same offset keep their order.
+class Coalescer
+{
+    struct Op
+    {
+        off_t offset;
+        char* data;
+        size_t size;
+    };
+
+    bool read;
+    std::vector<Op> ops;
+    std::vector<iovec> iov;
+
+public:
+    Coalescer(bool read) : read(read) {}
+
+    TAI_INLINE
+    void add(off_t offset, char* data, size_t size)
+    {
+        ops.push_back({offset, data, size});
+    }
+
+    TAI_INLINE
+    size_t size() const
+    {
+        return ops.size();
+    }
+
+    void flush(RandomWrite* rw)
+    {
+        using namespace std;
+
+        stable_sort(ops.begin(), ops.end(), [](const Op& a, const Op& b){ return a.offset < b.offset; });
+        size_t calls = 0;
+        for (size_t i = 0; i < ops.size(); ++calls)
+        {
+            auto offset = ops[i].offset, end = offset;
+            iov.clear();
+            for (; i < ops.size() && ops[i].offset == end && iov.size() < IOV_MAX; end += ops[i++].size)
+                iov.push_back({ops[i].data, ops[i].size});
+            if (iov.size() == 1 && read)
+                rw->readop(offset, ops[i - 1].data, ops[i - 1].size);
+            else if (iov.size() == 1)
+                rw->writeop(offset, ops[i - 1].data, ops[i - 1].size);
+            else if (read)
+                rw->readvop(offset, iov.data(), iov.size());
+            else
+                rw->writevop(offset, iov.data(), iov.size());
+        }
+        merges.add(rw->tid, ops.size(), calls);
+        ops.clear();
+    }
 };
 
+static void log_merges()
+{
+    using namespace tai;
+
+    if (VECTORED)
+        Log::log("vectored: ", merges.ops(), " ops in ", merges.calls(), " calls, merge ratio ",
+                merges.calls() ? (double)merges.ops() / merges.calls() : 0.);
+}
+
 //class TAIAIOWrite : public RandomWrite
 //{
 //    std::array<std::vector<tai::aiocb, tai::Alloc<tai::aiocb>>, MAX_THREAD_NUM> cbs;
@@ -712,7 +2059,7 @@ public:
 //    }
 //
 //    TAI_INLINE
-//    virtual void writeop(off_t offset, char* data) override
+//    virtual void writeop(off_t offset, char* data, size_t size = WRITE_SIZE) override
 //    {
 //        using namespace std;
 //        using namespace tai;
@@ -725,7 +2072,7 @@ public:
 //    }
 //
 //    TAI_INLINE
-//    virtual void readop(off_t offset, char* data) override
+//    virtual void readop(off_t offset, char* data, size_t size = READ_SIZE) override
 //    {
 //        using namespace std;
 //        using namespace tai;
@@ -905,7 +2252,7 @@ public:
 //    }
 //
 //    TAI_INLINE
-//    virtual void writeop(off_t offset, char* data) override
+//    virtual void writeop(off_t offset, char* data, size_t size = WRITE_SIZE) override
 //    {
 //        using namespace std;
 //        using namespace tai;
@@ -918,7 +2265,7 @@ public:
 //    }
 //
 //    TAI_INLINE
-//    virtual void readop(off_t offset, char* data) override
+//    virtual void readop(off_t offset, char* data, size_t size = READ_SIZE) override
 //    {
 //        using namespace std;
 //        using namespace tai;
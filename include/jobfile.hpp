@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Job files: INI-style phases that one driver process runs back to back, so
+// the page cache, the files and the harness state carry over between them.
+//
+//     ; or # starts a comment
+//     [global]             settings applied before every phase
+//     [fill]               a phase, named for the logs
+//     key = value          any name=value option, positional arguments by name
+//
+// Settings before the first section are global.  A file with no phase runs
+// its global settings as one phase named "global".  A phase keeps what earlier
+// phases set unless it or [global] sets it again, so defaults belong in
+// [global].  Options given next to job= on the command line win over all.
+//
+// A phase runs one group of `threads` threads with the same settings: the
+// harness settings are process-wide, so concurrent thread groups with their
+// own counts and workloads ([phase.group]) are rejected rather than run
+// approximately.  The interference driver covers a foreground probe under
+// background writers.
+class JobFile
+{
+public:
+    struct Phase
+    {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> settings;
+    };
+
+    std::string path;
+    std::vector<Phase> phases;
+    std::vector<std::pair<std::string, std::string>> overrides;    // from the command line
+
+    void load(const std::string& path)
+    {
+        std::ifstream fin(path);
+        if (!fin)
+        {
+            std::cerr << "Cannot open job file \"" << path << "\"." << std::endl;
+            exit(-1);
+        }
+        this->path = path;
+        phases.clear();
+        Phase global{"global", {}};
+        auto cur = &global;
+        size_t lineno = 0;
+        for (std::string line; std::getline(fin, line); )
+        {
+            ++lineno;
+            line = trim(line.substr(0, line.find_first_of(";#")));
+            if (line.empty())
+                continue;
+            if (line.front() == '[')
+            {
+                if (line.back() != ']' || line.size() < 3)
+                    fail(lineno, "malformed section header");
+                auto name = trim(line.substr(1, line.size() - 2));
+                if (name.find('.') != std::string::npos)
+                    fail(lineno, "thread groups like [" + name + "] are not supported, a phase runs one group");
+                if (name == "global")
+                    cur = &global;
+                else
+                {
+                    phases.push_back({name, {}});
+                    cur = &phases.back();
+                }
+                continue;
+            }
+            auto eq = line.find('=');
+            if (eq == std::string::npos)
+                fail(lineno, "expected key = value");
+            auto key = trim(line.substr(0, eq));
+            if (key.empty() || key == "job")
+                fail(lineno, "illegal key \"" + key + "\"");
+            cur->settings.emplace_back(key, trim(line.substr(eq + 1)));
+        }
+        if (phases.empty())
+            phases.push_back(global);
+        else
+            for (auto& p : phases)
+                p.settings.insert(p.settings.begin(), global.settings.begin(), global.settings.end());
+    }
+
+private:
+    static std::string trim(const std::string& str)
+    {
+        auto first = str.find_first_not_of(" \t\r");
+        if (first == std::string::npos)
+            return "";
+        return str.substr(first, str.find_last_not_of(" \t\r") - first + 1);
+    }
+
+    [[noreturn]] void fail(size_t lineno, const std::string& what) const
+    {
+        std::cerr << "Error in job file " << path << ":" << lineno << ": " << what << "." << std::endl;
+        exit(-1);
+    }
+};
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__MACH__)
+#include <sys/mman.h>
+#endif
+
+#include "tai.hpp"
+
+// Per-thread op counters sampled by a monitor thread every `interval` seconds.
+// Each benchmark thread only writes its own cache line, the monitor only reads,
+// so counting stays lock-free on the hot path.
+//
+// The monitor also drives time-based runs: ops done during `warmup` are excluded
+// from the statistics, the run stops `duration` seconds after the warm-up, or
+// earlier once the IOPS of the last `window` samples vary by less than `threshold`
+// (coefficient of variation).  Warm-up ends at the first sample after `warmup`.
+//
+// With `timeline` set, every sample also prints the interval IOPS, bandwidth and
+// latency percentiles, and rewrites `prom` (if given) in Prometheus text format.
+// Latencies go to per-thread log-linear histograms (4 buckets per power of two).
+// With `submit_latency` set, the recorded calls only submit the op, as on the
+// async backends, and the figures are labelled as submit latency.
+//
+// Counters and the stop and measuring flags live in shared anonymous memory, so worker processes
+// forked after setup() report to the same monitor as threads do.
+//
+// `on_sample`, if set, is called from the sampler with the seconds since start,
+// and keeps the sampler running even when nothing else needs it.  `on_warm`,
+// if set, is called from the sampler when the warm-up ends.
+class Monitor
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t BUCKETS = 256;
+
+    struct alignas(64) Counter
+    {
+        std::atomic<size_t> ops = {0};
+        std::atomic<size_t> bytes = {0};
+        std::array<std::atomic<size_t>, BUCKETS> lat = {};
+    };
+
+    double interval = 1;
+    double duration = 0;
+    double warmup = 0;
+    size_t window = 0;
+    double threshold = 0;
+    size_t timeline = 0;
+    bool submit_latency = false;
+    std::string prom;
+    std::function<void(double)> on_sample;
+    std::function<void()> on_warm;
+
+    TAI_INLINE
+    bool enabled() const
+    {
+        return duration > 0 || warmup > 0 || window || timeline;
+    }
+
+    Monitor() = default;
+    Monitor(const Monitor&) = delete;
+
+    ~Monitor()
+    {
+        release();
+    }
+
+    void setup(size_t threads)
+    {
+        release();
+        nthreads = threads;
+        block_size = sizeof(Counter) * (threads + 1);
+        #if defined(__unix__) || defined(__MACH__)
+        block = mmap(nullptr, block_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (block == MAP_FAILED)
+            throw std::bad_alloc();
+        #else
+        block = operator new(block_size);
+        #endif
+        stop = new (block) std::atomic<bool>(false);
+        measured = new (stop + 1) std::atomic<bool>(false);
+        counters = (Counter*)((char*)block + sizeof(Counter));
+        for (size_t i = 0; i < threads; ++i)
+            new (counters + i) Counter();
+    }
+
+    void start(size_t threads)
+    {
+        setup(threads);
+        start();
+    }
+
+    // Starts the clock (and the sampler) on counters prepared by setup().
+    void start()
+    {
+        done = false;
+        warm = warmup <= 0;
+        base_ops = 0;
+        samples.clear();
+        last_lat.assign(BUCKETS, 0);
+        last_bytes = 0;
+        measured->store(warm);
+        epoch = measure_start = clock::now();
+        if (enabled() || on_sample)
+            sampler = std::thread([this](){ sample_loop(); });
+    }
+
+    void finish()
+    {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            done = true;
+        }
+        cv.notify_all();
+        if (sampler.joinable())
+            sampler.join();
+        end = clock::now();
+        end_ops = total();
+        if (!warm)
+        {
+            tai::Log::log("Warning: run ended during warm-up, reporting it as measured.");
+            measure_start = epoch;
+            base_ops = 0;
+        }
+    }
+
+    TAI_INLINE
+    bool stopped() const
+    {
+        return stop->load(std::memory_order_relaxed);
+    }
+
+    // True once the warm-up is over.  After finish(), false only if the run
+    // ended during the warm-up, which is then reported as measured.
+    TAI_INLINE
+    bool measuring() const
+    {
+        return measured->load(std::memory_order_relaxed);
+    }
+
+    // Start stamp for record(), zero when latencies are not collected.
+    TAI_INLINE
+    clock::time_point now() const
+    {
+        return timeline ? clock::now() : clock::time_point();
+    }
+
+    TAI_INLINE
+    void record(size_t tid, size_t bytes, clock::time_point start = clock::time_point())
+    {
+        auto& c = counters[tid];
+        bump(c.ops, 1);
+        bump(c.bytes, bytes);
+        if (start != clock::time_point())
+            bump(c.lat[bucket(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count())], 1);
+    }
+
+    // Ops and nanoseconds of the measured (post warm-up) phase.
+    size_t ops() const
+    {
+        return end_ops - base_ops;
+    }
+
+    // Ops including the warm-up.
+    size_t all_ops() const
+    {
+        return end_ops;
+    }
+
+    long long time() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(end - measure_start).count();
+    }
+
+private:
+    void* block = nullptr;
+    size_t block_size = 0;
+    std::atomic<bool>* stop = nullptr;
+    std::atomic<bool>* measured = nullptr;
+    Counter* counters = nullptr;
+    size_t nthreads = 0;
+    std::thread sampler;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done = false;
+    bool warm = true;
+    clock::time_point epoch, measure_start, end;
+    size_t base_ops = 0, end_ops = 0;
+    std::deque<double> samples;
+    std::vector<size_t> last_lat;
+    size_t last_bytes = 0;
+    size_t last_ops_total = 0;
+
+    void release()
+    {
+        if (!block)
+            return;
+        #if defined(__unix__) || defined(__MACH__)
+        munmap(block, block_size);
+        #else
+        operator delete(block);
+        #endif
+        block = nullptr;
+    }
+
+    // Counters have a single writer, so no read-modify-write is needed.
+    TAI_INLINE
+    static void bump(std::atomic<size_t>& c, size_t n)
+    {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    TAI_INLINE
+    static size_t bucket(unsigned long long ns)
+    {
+        if (ns < 4)
+            return ns;
+        auto b = 63 - __builtin_clzll(ns);
+        return 4 * (b - 1) + (ns >> (b - 2) & 3);
+    }
+
+    // Upper bound of a bucket in nanoseconds.
+    static double bucket_ns(size_t idx)
+    {
+        if (idx < 4)
+            return idx + 1;
+        return std::ldexp(5 + idx % 4, idx / 4 - 1);
+    }
+
+    size_t total() const
+    {
+        size_t sum = 0;
+        for (size_t i = 0; i < nthreads; ++i)
+            sum += counters[i].ops.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    void report(double t, double dt, double iops)
+    {
+        using namespace std;
+        using namespace tai;
+
+        static const array<double, 4> qs = {.5, .9, .99, .999};
+
+        size_t bytes = 0, n = 0;
+        vector<size_t> lat(BUCKETS, 0);
+        for (size_t i = 0; i < nthreads; ++i)
+        {
+            bytes += counters[i].bytes.load(memory_order_relaxed);
+            for (size_t j = 0; j < BUCKETS; ++j)
+                lat[j] += counters[i].lat[j].load(memory_order_relaxed);
+        }
+        for (size_t j = 0; j < BUCKETS; ++j)
+        {
+            swap(lat[j], last_lat[j]);
+            lat[j] = last_lat[j] - lat[j];
+            n += lat[j];
+        }
+        auto bw = (bytes - last_bytes) / dt;
+        last_bytes = bytes;
+
+        array<double, qs.size()> pcts = {};
+        for (size_t j = 0, k = 0, acc = 0; j < BUCKETS && k < qs.size(); ++j)
+            for (acc += lat[j]; k < qs.size() && n && acc >= qs[k] * n; ++k)
+                pcts[k] = bucket_ns(j) / 1e3;
+
+        Log::log("timeline, ", t, ", ", iops, ", ", bw / (1 << 20), ", ",
+                pcts[0], ", ", pcts[1], ", ", pcts[2], ", ", pcts[3], warm ? "" : ", warm-up");
+
+        if (prom.empty())
+            return;
+        // Write aside and rename, so a scraper never sees a partial file.
+        string metric = submit_latency ? "iotest_submit_latency_seconds" : "iotest_latency_seconds";
+        ofstream fout(prom + ".tmp");
+        fout << "# TYPE iotest_ops_total counter\n"
+             << "iotest_ops_total " << last_ops_total << "\n"
+             << "# TYPE iotest_bytes_total counter\n"
+             << "iotest_bytes_total " << bytes << "\n"
+             << "# TYPE iotest_iops gauge\n"
+             << "iotest_iops " << iops << "\n"
+             << "# TYPE iotest_bandwidth_bytes gauge\n"
+             << "iotest_bandwidth_bytes " << bw << "\n"
+             << "# TYPE " << metric << " summary\n";
+        for (size_t k = 0; k < qs.size(); ++k)
+            fout << metric << "{quantile=\"" << qs[k] << "\"} " << pcts[k] / 1e6 << "\n";
+        fout << metric << "_count " << n << "\n"
+             << "# TYPE iotest_warm gauge\n"
+             << "iotest_warm " << warm << "\n";
+        fout.close();
+        rename((prom + ".tmp").c_str(), prom.c_str());
+    }
+
+    static double seconds(clock::duration d)
+    {
+        return std::chrono::duration<double>(d).count();
+    }
+
+    void sample_loop()
+    {
+        using namespace std;
+        using namespace tai;
+
+        auto step = chrono::duration_cast<clock::duration>(chrono::duration<double>(interval));
+        auto last = epoch;
+        size_t last_ops = 0;
+        if (timeline)
+        {
+            string lat = submit_latency ? "submit p" : "p";
+            Log::log("timeline, time(s), iops, MB/s, ", lat, "50(us), ", lat, "90(us), ", lat, "99(us), ", lat, "99.9(us)");
+        }
+        unique_lock<mutex> lck(mtx);
+        for (auto next = epoch + step; !cv.wait_until(lck, next, [this](){ return done; }); next += step)
+        {
+            auto now = clock::now();
+            auto ops = total();
+            auto dt = seconds(now - last);
+            auto iops = (ops - last_ops) / dt;
+            last = now;
+            last_ops = last_ops_total = ops;
+            if (timeline)
+                report(seconds(now - epoch), dt, iops);
+            if (on_sample)
+                on_sample(seconds(now - epoch));
+
+            if (!warm)
+            {
+                if (seconds(now - epoch) < warmup)
+                    continue;
+                warm = true;
+                measured->store(true);
+                measure_start = now;
+                base_ops = ops;
+                Log::log("Warm-up finished after ", seconds(now - epoch), " s, ", ops, " ops.");
+                if (on_warm)
+                    on_warm();
+                continue;
+            }
+
+            samples.emplace_back(iops);
+            if (window && samples.size() > window)
+                samples.pop_front();
+            if (window && samples.size() == window)
+            {
+                double mean = 0, var = 0;
+                for (auto i : samples)
+                    mean += i;
+                mean /= window;
+                for (auto i : samples)
+                    var += (i - mean) * (i - mean);
+                auto cov = sqrt(var / window) / mean;
+                if (mean > 0 && cov < threshold)
+                {
+                    Log::log("Steady state after ", seconds(now - epoch), " s: ", mean, " iops, cv ", cov);
+                    stop->store(true);
+                }
+            }
+            if (duration > 0 && seconds(now - measure_start) >= duration)
+                stop->store(true);
+        }
+    }
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "Decl.hpp"
+#include "workload.hpp"
+
+// Contents of the write buffers:
+//     const    every byte 'a'; compresses and dedups to nothing
+//     random   xorshift output refreshed before every op: incompressible, never repeats
+//     ratio:R  per 4K, the first 4K/R bytes random and refreshed per op, the rest
+//              zero, so compressors get about R:1
+//     unique   random once, then a 16-byte stamp per 512 B sector per op: no two
+//              sectors are equal, so dedup finds nothing, at a fraction of the
+//              cost of random; stream compressors still see the shared template
+// Buffers may still be in flight on async backends when the next op refreshes
+// them; only their contents race, which is harmless here.
+class Payload
+{
+public:
+    enum Mode { Const, Random, Ratio, Unique };
+
+    Mode mode = Const;
+    double ratio = 1;
+
+    void parse(const std::string& spec)
+    {
+        if (spec == "const")
+            mode = Const;
+        else if (spec == "random")
+            mode = Random;
+        else if (spec == "unique")
+            mode = Unique;
+        else if (!spec.compare(0, 6, "ratio:") && std::stod(spec.substr(6)) >= 1)
+        {
+            mode = Ratio;
+            ratio = std::stod(spec.substr(6));
+        }
+        else
+        {
+            std::cerr << "Unknown payload \"" << spec << "\"." << std::endl;
+            exit(-1);
+        }
+    }
+
+    std::string str() const
+    {
+        static const char* names[] = {"const", "random", "ratio", "unique"};
+        std::ostringstream os;
+        os << names[mode];
+        if (mode == Ratio)
+            os << " " << ratio << ":1";
+        return os.str();
+    }
+
+    // Fills a fresh buffer.
+    void init(char* buf, size_t size, XorShift& rng) const
+    {
+        if (mode == Const)
+            memset(buf, 'a', size);
+        else
+        {
+            memset(buf, 0, size);
+            next(buf, size, rng, 0);
+            if (mode == Unique)
+                random(buf, size, rng);
+        }
+    }
+
+    // Refreshes the buffer before op number seq.
+    TAI_INLINE
+    void next(char* buf, size_t size, XorShift& rng, uint64_t seq) const
+    {
+        switch (mode)
+        {
+        case Const:
+            break;
+        case Random:
+            random(buf, size, rng);
+            break;
+        case Ratio:
+            for (size_t i = 0; i < size; i += CHUNK)
+                random(buf + i, std::min(size - i, (size_t)(CHUNK / ratio)), rng);
+            break;
+        case Unique:
+        {
+            uint64_t stamp[2] = {rng(), seq};
+            for (size_t i = 0; i + sizeof(stamp) <= size; i += SECTOR, ++stamp[1])
+                memcpy(buf + i, stamp, sizeof(stamp));
+            break;
+        }
+        }
+    }
+
+private:
+    static constexpr size_t CHUNK = 4096, SECTOR = 512;
+
+    // 32 bytes per step keeps the stores wide and the loop overhead low.
+    TAI_INLINE
+    static void random(char* buf, size_t size, XorShift& rng)
+    {
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            uint64_t w[4] = {rng(), rng(), rng(), rng()};
+            memcpy(buf + i, w, sizeof(w));
+        }
+        for (; i < size; ++i)
+            buf[i] = rng();
+    }
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cctype>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <new>
+
+#if defined(__unix__) || defined(__MACH__)
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#endif
+
+// CPU pinning and NUMA-local memory for benchmark threads.
+// Topology comes from sysfs so that no libnuma is needed.
+
+struct Placement
+{
+    int cpu = -1;
+    int node = -1;
+};
+
+// Parse a kernel cpulist such as "0-3,8,10-11".
+static std::vector<int> parse_cpulist(const std::string& str)
+{
+    std::vector<int> res;
+    size_t pos = 0;
+    while (pos < str.size())
+    {
+        auto end = str.find(',', pos);
+        if (end == std::string::npos)
+            end = str.size();
+        auto item = str.substr(pos, end - pos);
+        auto dash = item.find('-');
+        if (!item.empty() && isdigit(item[0]))
+        {
+            auto lo = std::stoi(item);
+            auto hi = dash == std::string::npos ? lo : std::stoi(item.substr(dash + 1));
+            for (auto i = lo; i <= hi; ++i)
+                res.emplace_back(i);
+        }
+        pos = end + 1;
+    }
+    return res;
+}
+
+// CPUs of each NUMA node; a single node with every online CPU if sysfs has no node info.
+static const std::vector<std::vector<int>>& numa_nodes()
+{
+    static const auto nodes = [](){
+        std::vector<std::vector<int>> nodes;
+        for (int i = 0; ; ++i)
+        {
+            std::ifstream fin("/sys/devices/system/node/node" + std::to_string(i) + "/cpulist");
+            std::string line;
+            if (!fin || !std::getline(fin, line))
+                break;
+            nodes.emplace_back(parse_cpulist(line));
+        }
+        if (nodes.empty())
+        {
+            nodes.emplace_back();
+            #ifdef _SC_NPROCESSORS_ONLN
+            for (int i = 0, n = sysconf(_SC_NPROCESSORS_ONLN); i < n; ++i)
+                nodes.back().emplace_back(i);
+            #endif
+        }
+        return nodes;
+    }();
+    return nodes;
+}
+
+static int cpu_node(int cpu)
+{
+    auto& nodes = numa_nodes();
+    for (size_t i = 0; i < nodes.size(); ++i)
+        for (auto c : nodes[i])
+            if (c == cpu)
+                return i;
+    return -1;
+}
+
+// CPU order for a pinning policy:
+//     compact: fill node 0 first, then node 1, ...
+//     scatter: round-robin across nodes
+//     otherwise an explicit cpulist, e.g. "0,2,4-7"
+static std::vector<int> pin_order(const std::string& policy)
+{
+    auto& nodes = numa_nodes();
+    std::vector<int> order;
+    if (policy == "compact")
+    {
+        for (auto& n : nodes)
+            order.insert(order.end(), n.begin(), n.end());
+    }
+    else if (policy == "scatter")
+    {
+        for (size_t i = 0, more = 1; more; ++i)
+        {
+            more = 0;
+            for (auto& n : nodes)
+                if (i < n.size())
+                {
+                    order.emplace_back(n[i]);
+                    more = 1;
+                }
+        }
+    }
+    else
+        order = parse_cpulist(policy);
+    return order;
+}
+
+static bool pin_thread(int cpu)
+{
+    #ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    #else
+    return false;
+    #endif
+}
+
+// Page-aligned buffer preferring the given node (-1 for the default policy).
+// The buffer is touched by the caller's thread, so first-touch placement agrees with the binding.
+static char* alloc_local(size_t size, int node)
+{
+    #if defined(__unix__) || defined(__MACH__)
+    auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        throw std::bad_alloc();
+    #ifdef SYS_mbind
+    if (node >= 0)
+    {
+        static constexpr int MPOL_PREFERRED = 1;
+        unsigned long mask[16] = {};
+        mask[node / (8 * sizeof(long))] |= 1ul << node % (8 * sizeof(long));
+        syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0);
+    }
+    #endif
+    for (size_t i = 0; i < size; i += 4096)
+        ((volatile char*)ptr)[i] = 0;
+    return (char*)ptr;
+    #else
+    return new char[size];
+    #endif
+}
+
+static void free_local(char* ptr, size_t size)
+{
+    if (!ptr)
+        return;
+    #if defined(__unix__) || defined(__MACH__)
+    munmap(ptr, size);
+    #else
+    delete[] ptr;
+    #endif
+}
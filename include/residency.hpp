@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__MACH__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "tai.hpp"
+
+// Page-cache residency of the test files, from mincore() on a read-only
+// shared mapping of each file.  Mapping does not fault pages in, so the
+// scan does not disturb what it measures.
+class Residency
+{
+    std::vector<std::string> files;
+
+public:
+    Residency(const std::vector<std::string>& files) : files(files) {}
+
+    const std::vector<std::string>& paths() const
+    {
+        return files;
+    }
+
+    // Fraction of the file's pages in the page cache, -1 if it cannot be mapped.
+    static double resident(const std::string& path)
+    {
+        #if defined(__unix__) || defined(__MACH__)
+        auto fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) || !st.st_size)
+        {
+            if (fd >= 0)
+                close(fd);
+            return -1;
+        }
+        auto ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (ptr == MAP_FAILED)
+            return -1;
+        size_t page = sysconf(_SC_PAGESIZE), pages = (st.st_size + page - 1) / page, in = 0;
+        #ifdef __linux__
+        std::vector<unsigned char> vec(pages);
+        #else
+        std::vector<char> vec(pages);
+        #endif
+        if (!mincore(ptr, st.st_size, vec.data()))
+            for (auto v : vec)
+                in += v & 1;
+        munmap(ptr, st.st_size);
+        return (double)in / pages;
+        #else
+        return -1;
+        #endif
+    }
+
+    // One line per scan: "residency, <when>, <% of file0>, <% of file1>, ..."
+    void log(const std::string& when) const
+    {
+        std::string line = "residency, " + when;
+        for (auto& f : files)
+        {
+            auto r = resident(f);
+            line += r < 0 ? ", -" : ", " + std::to_string(100 * r);
+        }
+        tai::Log::log(line);
+    }
+};
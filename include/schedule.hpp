@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <new>
+
+#if defined(__unix__) || defined(__MACH__)
+#include <sys/mman.h>
+#endif
+
+#include "Decl.hpp"
+
+// Op sequence of one thread, generated before the clock starts: for the same
+// seed every backend replays the same offsets, and no RNG runs in the timed
+// loop.  A run that outlives the schedule, as a time-based one does, has the
+// generator fill in the next n ops where the last pass left off, so it keeps
+// drawing fresh offsets; that refill runs in the timed loop, once per pass.
+class Schedule
+{
+public:
+    struct Op
+    {
+        uint64_t offset;
+        uint32_t size;
+        uint8_t read;
+        uint8_t sync;
+    };
+
+    Schedule() = default;
+    Schedule(const Schedule&) = delete;
+
+    Schedule(Schedule&& other) noexcept : ops(other.ops), len(other.len), pos(other.pos), gen(std::move(other.gen))
+    {
+        other.ops = nullptr;
+    }
+
+    ~Schedule()
+    {
+        release();
+    }
+
+    // Fills n ops with gen(Op&), and every later pass of n ops as well.
+    void generate(size_t n, std::function<void(Op&)> g)
+    {
+        release();
+        gen = std::move(g);
+        len = n ? n : 1;
+        #if defined(__unix__) || defined(__MACH__)
+        auto ptr = mmap(nullptr, len * sizeof(Op), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            throw std::bad_alloc();
+        #else
+        auto ptr = operator new(len * sizeof(Op));
+        #endif
+        ops = (Op*)ptr;
+        refill();
+    }
+
+    TAI_INLINE
+    const Op& next()
+    {
+        if (__builtin_expect(pos == len, 0))
+            refill();
+        return ops[pos++];
+    }
+
+    size_t size() const
+    {
+        return ops ? len : 0;
+    }
+
+private:
+    Op* ops = nullptr;
+    size_t len = 0;
+    size_t pos = 0;
+    std::function<void(Op&)> gen;
+
+    void refill()
+    {
+        for (size_t i = 0; i < len; ++i)
+            gen(ops[i]);
+        pos = 0;
+    }
+
+    void release()
+    {
+        if (!ops)
+            return;
+        #if defined(__unix__) || defined(__MACH__)
+        munmap(ops, len * sizeof(Op));
+        #else
+        operator delete(ops);
+        #endif
+        ops = nullptr;
+    }
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <new>
+
+#if defined(__unix__) || defined(__MACH__)
+#include <sys/mman.h>
+#endif
+
+#include "Decl.hpp"
+
+// Per-thread slots in shared anonymous memory, so forked worker processes
+// count into the same slots as threads.  Sized for thread_num before any
+// thread or worker starts; resizing drops the old slots.
+template<typename Slot>
+class SharedSlots
+{
+public:
+    SharedSlots(size_t n)
+    {
+        resize(n);
+    }
+
+    SharedSlots(const SharedSlots&) = delete;
+
+    ~SharedSlots()
+    {
+        release();
+    }
+
+    // Maps n zeroed slots, at least one; false if there were n slots already.
+    bool resize(size_t n)
+    {
+        n = n ? n : 1;
+        if (slots && n == nslots)
+            return false;
+        release();
+        #if defined(__unix__) || defined(__MACH__)
+        auto ptr = mmap(nullptr, sizeof(Slot) * n, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            throw std::bad_alloc();
+        #else
+        auto ptr = operator new(sizeof(Slot) * n);
+        #endif
+        slots = (Slot*)ptr;
+        nslots = n;
+        for (size_t i = 0; i < n; ++i)
+            new (slots + i) Slot();
+        return true;
+    }
+
+    size_t size() const
+    {
+        return nslots;
+    }
+
+    TAI_INLINE
+    Slot& operator[](size_t i)
+    {
+        return slots[i];
+    }
+
+    TAI_INLINE
+    const Slot& operator[](size_t i) const
+    {
+        return slots[i];
+    }
+
+private:
+    Slot* slots = nullptr;
+    size_t nslots = 0;
+
+    void release()
+    {
+        if (!slots)
+            return;
+        #if defined(__unix__) || defined(__MACH__)
+        munmap(slots, sizeof(Slot) * nslots);
+        #else
+        operator delete(slots);
+        #endif
+        slots = nullptr;
+    }
+};
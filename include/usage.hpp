@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <string>
+
+#if defined(__unix__) || defined(__MACH__)
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "tai.hpp"
+
+// CPU time, context switches and peak RSS of the measured phase, from
+// getrusage().  The peak comes from VmHWM, which start() resets through
+// clear_refs where the kernel allows it, so allocations made before the
+// phase do not count.  For forked workers the children's usage is taken
+// after they have been reaped, and the peak is that of the largest child;
+// there is no baseline for a child, so no growth is reported then.
+class Usage
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    void start(bool children = false)
+    {
+        #if defined(__unix__) || defined(__MACH__)
+        who = children ? RUSAGE_CHILDREN : RUSAGE_SELF;
+        std::ofstream("/proc/self/clear_refs") << "5";
+        base_kb = status_kb("VmRSS:");
+        getrusage(who, &before);
+        #endif
+        t0 = clock::now();
+    }
+
+    // Starts over when the warm-up ends.  Children only count once they are
+    // reaped, so for forked workers the warm-up stays in.
+    void restart()
+    {
+        #if defined(__unix__) || defined(__MACH__)
+        if (who == RUSAGE_CHILDREN)
+            return;
+        #endif
+        start();
+    }
+
+    void stop()
+    {
+        t1 = clock::now();
+        #if defined(__unix__) || defined(__MACH__)
+        getrusage(who, &after);
+        // ru_maxrss is in KB on Linux.
+        peak_kb = who == RUSAGE_SELF ? status_kb("VmHWM:") : 0;
+        if (!peak_kb)
+            peak_kb = after.ru_maxrss;
+        #endif
+    }
+
+    // Logs the cost of ops done with at most `inflight` ops outstanding.
+    void report(size_t ops, size_t inflight) const
+    {
+        using namespace tai;
+
+        #if defined(__unix__) || defined(__MACH__)
+        auto user = seconds(after.ru_utime) - seconds(before.ru_utime);
+        auto sys = seconds(after.ru_stime) - seconds(before.ru_stime);
+        auto wall = std::chrono::duration<double>(t1 - t0).count();
+        auto growth = peak_kb > base_kb ? (peak_kb - base_kb) << 10 : 0;
+        Log::log("usage: ", user, " s user, ", sys, " s sys, ", (user + sys) / wall, " cores busy, ",
+                after.ru_nvcsw - before.ru_nvcsw, " voluntary / ",
+                after.ru_nivcsw - before.ru_nivcsw, " involuntary context switches");
+        if (who == RUSAGE_CHILDREN)
+            Log::log("usage: ", user + sys > 0 ? ops / (user + sys) : 0., " iops per core, peak RSS ",
+                    peak_kb / 1024., " MB of the largest worker");
+        else
+            Log::log("usage: ", user + sys > 0 ? ops / (user + sys) : 0., " iops per core, peak RSS ",
+                    peak_kb / 1024., " MB (+", growth / 1048576., " MB), ",
+                    inflight ? growth / inflight : 0, " B of RSS growth per in-flight op (", inflight, ")");
+        #endif
+    }
+
+private:
+    #if defined(__unix__) || defined(__MACH__)
+    int who = RUSAGE_SELF;
+    rusage before = {}, after = {};
+
+    static double seconds(const timeval& tv)
+    {
+        return tv.tv_sec + tv.tv_usec * 1e-6;
+    }
+    #endif
+    size_t base_kb = 0, peak_kb = 0;
+    clock::time_point t0, t1;
+
+    static size_t status_kb(const std::string& key)
+    {
+        std::ifstream fin("/proc/self/status");
+        for (std::string line; std::getline(fin, line); )
+            if (!line.compare(0, key.size(), key))
+                return std::stoull(line.substr(key.size()));
+        return 0;
+    }
+};
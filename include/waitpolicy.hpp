@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#if defined(__unix__) || defined(__MACH__)
+#include <sched.h>
+#endif
+
+#include "tai.hpp"
+#include "slots.hpp"
+
+// How the backends wait for completions they can poll for:
+//     spin   poll back to back
+//     yield  spin for the budget, then sched_yield() between polls
+//     sleep  spin for the budget, then sleep between polls, backing off from 1 us to 1 ms
+//     block  the backend's blocking wait (aio_suspend, io_getevents without timeout)
+// The spin budget is fixed with spin=<us>, or else learned per thread as twice
+// the moving average of recent waits, capped at MAX_SPIN: completions that come
+// quickly are caught spinning, slow ones stop burning a core.  Without a policy
+// the backends keep their own waits (POSIX AIO polls every 1 ms or spins in
+// busywait_cb, LibAIO blocks).  Slots live in shared anonymous memory so forked
+// workers are counted too, one per thread of the run.
+class WaitPolicy
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    enum Mode { Default, Spin, Yield, Sleep, Block };
+
+    static constexpr long long MAX_SPIN = 100000;   // ns
+
+    struct alignas(64) Slot
+    {
+        std::atomic<long long> waits, spun, ns, avg;    // avg: moving average of waits, ns
+    };
+
+    Mode mode = Default;
+    long long spin = -1;    // fixed budget in ns, -1 to learn it
+
+    WaitPolicy(size_t threads) : slots(threads)
+    {
+        init();
+    }
+
+    // Learned budgets survive unless the thread count changes.
+    void resize(size_t threads)
+    {
+        if (slots.resize(threads))
+            init();
+    }
+
+    void parse(const std::string& spec)
+    {
+        static const char* names[] = {"default", "spin", "yield", "sleep", "block"};
+        auto it = std::find(std::begin(names), std::end(names), spec);
+        if (it == std::end(names))
+        {
+            std::cerr << "Unknown wait policy \"" << spec << "\"." << std::endl;
+            exit(-1);
+        }
+        mode = (Mode)(it - std::begin(names));
+    }
+
+    std::string str() const
+    {
+        static const char* names[] = {"default", "spin", "yield", "sleep", "block"};
+        std::string s = names[mode];
+        if (mode == Yield || mode == Sleep)
+            s += spin < 0 ? ", adaptive spin budget" : ", spin budget " + std::to_string(spin / 1000) + " us";
+        return s;
+    }
+
+    // Returns once done() holds; block() is the blocking wait that makes it hold.
+    template<typename Done, typename Blocking>
+    TAI_INLINE
+    void wait(size_t tid, Done&& done, Blocking&& block)
+    {
+        using namespace std::chrono;
+
+        auto& s = slots[tid];
+        if (done())
+        {
+            // Already complete: counts as caught spinning, but does not teach the budget.
+            s.waits.store(s.waits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            s.spun.store(s.spun.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        auto start = clock::now();
+        auto avg = s.avg.load(std::memory_order_relaxed);
+        auto budget = mode == Spin ? LLONG_MAX : spin >= 0 ? spin : std::min(2 * avg, MAX_SPIN);
+        auto spun = true;
+        if (mode == Block)
+        {
+            block();
+            spun = false;
+        }
+        else
+            for (long long nap = 1000; !done(); )
+            {
+                if (duration_cast<nanoseconds>(clock::now() - start).count() < budget)
+                    continue;
+                spun = false;
+                if (mode == Yield)
+                    sched_yield();
+                else
+                {
+                    std::this_thread::sleep_for(nanoseconds(nap));
+                    nap = std::min(nap * 2, 1000000ll);
+                }
+            }
+        auto ns = duration_cast<nanoseconds>(clock::now() - start).count();
+        s.waits.store(s.waits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        s.spun.store(s.spun.load(std::memory_order_relaxed) + spun, std::memory_order_relaxed);
+        s.ns.store(s.ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        s.avg.store(avg + (ns - avg) / 8, std::memory_order_relaxed);
+    }
+
+    // Clears the counters; learned budgets are kept.
+    void reset()
+    {
+        for (size_t i = 0; i < slots.size(); ++i)
+        {
+            slots[i].waits.store(0);
+            slots[i].spun.store(0);
+            slots[i].ns.store(0);
+        }
+    }
+
+    // "wait: <policy>, <n> waits, <avg> us avg, <%> within the spin budget"
+    void log() const
+    {
+        if (mode == Default)
+            return;
+        long long waits = 0, spun = 0, ns = 0;
+        for (size_t i = 0; i < slots.size(); ++i)
+        {
+            waits += slots[i].waits.load(std::memory_order_relaxed);
+            spun += slots[i].spun.load(std::memory_order_relaxed);
+            ns += slots[i].ns.load(std::memory_order_relaxed);
+        }
+        tai::Log::log("wait: ", str(), ", ", waits, " waits, ", waits ? 1e-3 * ns / waits : 0., " us avg, ",
+                waits ? 100. * spun / waits : 0., "% within the spin budget");
+    }
+
+private:
+    SharedSlots<Slot> slots;
+
+    void init()
+    {
+        for (size_t i = 0; i < slots.size(); ++i)
+            slots[i].avg.store(MAX_SPIN / 4);
+    }
+};
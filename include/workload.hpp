@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "Decl.hpp"
+
+// xorshift64*: cheap per-thread generator behind the harness's randomness:
+// op mix, offsets, payloads and the drivers' keys and links.
+class XorShift
+{
+    uint64_t s;
+
+public:
+    XorShift(uint64_t seed) : s(seed ? seed : 0x9e3779b97f4a7c15ull) {}
+
+    TAI_INLINE
+    uint64_t operator()()
+    {
+        s ^= s >> 12;
+        s ^= s << 25;
+        s ^= s >> 27;
+        return s * 0x2545f4914f6cdd1dull;
+    }
+
+    // Uniform in [0, 1).
+    TAI_INLINE
+    double real()
+    {
+        return ((*this)() >> 11) * 0x1.0p-53;
+    }
+};
+
+// "512", "4K", "64k", "1M", "1G" -> bytes
+static size_t parse_size(const std::string& str)
+{
+    size_t pos;
+    auto val = std::stoull(str, &pos);
+    if (pos < str.size())
+        switch (str[pos])
+        {
+        case 'g': case 'G': val <<= 10;
+            [[fallthrough]];
+        case 'm': case 'M': val <<= 10;
+            [[fallthrough]];
+        case 'k': case 'K': val <<= 10;
+            break;
+        default:
+            std::cerr << "Illegal size \"" << str << "\"." << std::endl;
+            exit(-1);
+        }
+    return val;
+}
+
+// Block-size distribution:
+//     fixed     "4K"
+//     uniform   "4K-64K", multiples of the lowest set bit of the lower bound
+//     weighted  "4K:60,64K:30,1M:10"
+class SizeDist
+{
+    std::vector<std::pair<size_t, double>> table;   // size, cumulative weight
+    size_t lo = 0, hi = 0, step = 1;
+
+public:
+    SizeDist() = default;
+
+    SizeDist(size_t size) : lo(size), hi(size) {}
+
+    SizeDist(const std::string& spec)
+    {
+        if (spec.find(':') != std::string::npos)
+        {
+            double sum = 0;
+            for (size_t pos = 0; pos < spec.size(); )
+            {
+                auto end = spec.find(',', pos);
+                if (end == std::string::npos)
+                    end = spec.size();
+                auto item = spec.substr(pos, end - pos);
+                auto colon = item.find(':');
+                auto size = parse_size(item.substr(0, colon));
+                auto weight = colon == std::string::npos ? 1 : std::stod(item.substr(colon + 1));
+                if (weight < 0)
+                {
+                    std::cerr << "Illegal weight in \"" << spec << "\"." << std::endl;
+                    exit(-1);
+                }
+                sum += weight;
+                table.emplace_back(size, sum);
+                hi = std::max(hi, size);
+                pos = end + 1;
+            }
+            if (sum <= 0)
+            {
+                std::cerr << "All weights of \"" << spec << "\" are zero." << std::endl;
+                exit(-1);
+            }
+            for (auto& i : table)
+                i.second /= sum;
+            lo = hi;
+            for (auto& i : table)
+                lo = std::min(lo, i.first);
+            return;
+        }
+        auto dash = spec.find('-');
+        lo = parse_size(spec.substr(0, dash));
+        hi = dash == std::string::npos ? lo : parse_size(spec.substr(dash + 1));
+        step = lo & -lo;
+        if (hi < lo)
+        {
+            std::cerr << "Illegal size range \"" << spec << "\"." << std::endl;
+            exit(-1);
+        }
+    }
+
+    TAI_INLINE
+    size_t max() const
+    {
+        return hi;
+    }
+
+    TAI_INLINE
+    size_t operator()(XorShift& rng) const
+    {
+        if (!table.empty())
+        {
+            auto r = rng.real();
+            for (auto& i : table)
+                if (r < i.second)
+                    return i.first;
+            return table.back().first;
+        }
+        if (lo == hi)
+            return lo;
+        return lo + rng() % ((hi - lo) / step + 1) * step;
+    }
+
+    std::string str() const
+    {
+        std::string res;
+        if (table.empty())
+            return std::to_string(lo) + (lo == hi ? "" : "-" + std::to_string(hi));
+        double last = 0;
+        for (auto& i : table)
+        {
+            res += (res.empty() ? "" : ",") + std::to_string(i.first) + ":" + std::to_string(i.second - last);
+            last = i.second;
+        }
+        return res;
+    }
+};
+
+// Op generator of the mixed workload: read/write ratio, block sizes per op type
+// and the probability that an op of each type is followed by a sync.
+class Workload
+{
+public:
+    struct Op
+    {
+        bool read;
+        bool sync;
+        size_t size;
+    };
+
+    double read_ratio = .5;
+    SizeDist rbs, wbs;
+    double rsync = 0;
+    double wsync = -1;  // defaults to 1 / SYNC_RATE
+
+    TAI_INLINE
+    Op operator()(XorShift& rng) const
+    {
+        Op op;
+        op.read = rng.real() < read_ratio;
+        op.size = op.read ? rbs(rng) : wbs(rng);
+        op.sync = rng.real() < (op.read ? rsync : wsync);
+        return op;
+    }
+};
+
+// Zipfian ranks in [0, n) with skew theta in [0, 1), 0 being uniform: the
+// method of Gray et al., "Quickly generating billion-record synthetic
+// databases", as used by YCSB.  Rank 0 is the hottest.
+class Zipf
+{
+    size_t n;
+    double theta, alpha, zetan, eta;
+
+    static double zeta(size_t n, double theta)
+    {
+        double sum = 0;
+        for (size_t i = 1; i <= n; ++i)
+            sum += 1 / std::pow((double)i, theta);
+        return sum;
+    }
+
+public:
+    Zipf(size_t n, double theta) : n(n), theta(theta)
+    {
+        zetan = zeta(n, theta);
+        alpha = 1 / (1 - theta);
+        eta = (1 - std::pow(2. / n, 1 - theta)) / (1 - zeta(2, theta) / zetan);
+    }
+
+    TAI_INLINE
+    size_t operator()(XorShift& rng) const
+    {
+        if (!theta || n < 3)
+            return rng() % n;
+        auto u = rng.real();
+        auto uz = u * zetan;
+        if (uz < 1)
+            return 0;
+        if (uz < 1 + std::pow(.5, theta))
+            return 1;
+        return std::min(n - 1, (size_t)(n * std::pow(eta * u - eta + 1, alpha)));
+    }
+};
@@ -1,13 +1,14 @@
 #include <atomic>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "iotest.hpp"
 
 size_t testType;
 size_t workload;
 size_t thread_num = 1;
-size_t FILE_SIZE = 1 << 31;
+size_t FILE_SIZE = 1ull << 31;
 size_t READ_SIZE = 1 << 12;
 size_t WRITE_SIZE = 1 << 12;
 size_t IO_ROUND = 1 << 10;
@@ -15,6 +16,47 @@ size_t SYNC_RATE = 1;
 size_t WAIT_RATE = 1;
 
 size_t SINGLE_FILE = 0;
+size_t FILE_NUM = 0;
+std::vector<std::string> FILE_DIRS = {"tmp"};
+std::string PIN_POLICY = "none";
+size_t NUMA_LOCAL = 0;
+thread_local Placement placement;
+Monitor monitor;
+Workload mixgen;
+size_t STL_SHARED = 0;
+ssize_t STL_BUF = -1;
+size_t PROC_MODE = 0;
+std::string TARGET = "file";
+std::string TMPFS_DIR = "/dev/shm";
+size_t AIO_FSYNC = 0;
+size_t TX_CHAIN = 0;
+size_t VECTORED = 0;
+MergeStats merges(1);
+uint64_t SEED = 0;
+std::vector<Schedule> schedules;
+std::string META_SYNC = "fsync";
+size_t META_DIRSYNC = 1;
+std::string META_LAYOUT = "thread";
+size_t META_APPENDS = 1;
+std::string ACCESS = "random";
+size_t STRIDE = 0;
+std::string FADVISE = "none";
+size_t PREFETCH = 0;
+size_t FINAL_SYNC = 0;
+size_t RESIDENCY = 0;
+Payload PAYLOAD;
+WaitPolicy WAIT(1);
+double PROBE_RATE = 100;
+size_t PROBE_SYNC = 0;
+std::string KV_MIX = "80:15:5";
+double ZIPF_THETA = .99;
+size_t KV_VALUE = 100;
+size_t KV_KEYS = 0;
+size_t CHASE_DEPTH = 4;
+std::string COPY_METHOD = "rw";
+JobFile JOB;
+size_t PHASE = 0;
+Accounting breakdown(1);
 thread_local ssize_t RandomWrite::tid = 0;
 
 //std::unique_ptr<tai::Controller> TAIWrite::ctrl;
@@ -26,6 +68,8 @@ std::unique_ptr<RandomWrite> RandomWrite::getInstance(int testType, bool concurr
     static atomic_flag init = ATOMIC_FLAG_INIT;
     auto first = !init.test_and_set();
 
+    check_backend_threads(testType);
+
     unique_ptr<RandomWrite> rw;
     switch (testType)
     {
@@ -53,6 +97,9 @@ std::unique_ptr<RandomWrite> RandomWrite::getInstance(int testType, bool concurr
         else
             rw.reset(new LibAIOWrite<false>());
         break;
+    case 7:
+        rw.reset(new NullWrite());
+        break;
 //    case 5:
 //        if (first)
 //            tai::aio_init();
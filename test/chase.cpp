@@ -0,0 +1,192 @@
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <thread>
+#include <memory>
+
+#include "iotest.hpp"
+
+// Pointer chasing: every READ_SIZE block of a thread's part of its file
+// starts with the offset of another block of the part.  A lookup reads a
+// random block and follows `depth` - 1 links from it, like a B+tree descent or
+// a walk over linked pages, so a thread never has more than one read in
+// flight and latency alone bounds its throughput.  Run with growing thread
+// counts to see how many clients saturate the device.
+//
+// The links are written before the measured phase.  A link that reads back
+// out of range (Null backend, torn block) is counted as broken and replaced
+// by a random block.  IO_ROUND lookups per thread; testType selects the
+// backend, the workload, write size and sync and wait rates are not used.
+
+struct Client
+{
+    std::vector<double> lookups, reads;     // us per lookup, and of its reads
+    size_t warm = 0;                        // lookups started during the warm-up
+    size_t broken = 0;
+};
+
+static std::vector<Client> clients;
+
+static void build(RandomWrite* rw, off_t base, size_t blocks, XorShift& rng)
+{
+    static const size_t batch = 256;
+
+    auto buf = alloc_buffer(batch * READ_SIZE);
+    auto prng = payload_rng(RandomWrite::tid);
+    PAYLOAD.init(buf, batch * READ_SIZE, prng);
+    for (size_t b = 0; b < blocks; b += batch)
+    {
+        auto n = std::min(batch, blocks - b);
+        for (size_t j = 0; j < n; ++j)
+        {
+            auto to = rng() % blocks;
+            to += to == b + j;
+            uint64_t next = base + to % blocks * READ_SIZE;
+            memcpy(buf + j * READ_SIZE, &next, sizeof(next));
+        }
+        rw->writeop(base + b * READ_SIZE, buf, n * READ_SIZE);
+        rw->wait_cb();
+    }
+    rw->syncop();
+    rw->wait_cb();
+    free_buffer(buf, batch * READ_SIZE);
+}
+
+void run(RandomWrite* rw, size_t tid, off_t base, size_t blocks)
+{
+    using namespace std;
+    using namespace chrono;
+    using namespace tai;
+
+    rw->tid = tid;
+    place_thread(tid);
+    auto& c = clients[tid];
+    auto buf = alloc_buffer(READ_SIZE);
+    auto rng = thread_rng(tid);
+    auto end = base + (off_t)(blocks * READ_SIZE);
+    for (size_t i = 0; keep_running(i); ++i)
+    {
+        off_t off = base + rng() % blocks * READ_SIZE;
+        c.warm += !monitor.measuring();
+        long long read_ns = 0;
+        auto start = steady_clock::now();
+        auto mstart = monitor.now();
+        for (size_t d = 0; d < CHASE_DEPTH; ++d)
+        {
+            auto rstart = steady_clock::now();
+            rw->readop(off, buf, READ_SIZE);
+            rw->wait_cb();
+            read_ns += duration_cast<nanoseconds>(steady_clock::now() - rstart).count();
+            uint64_t next;
+            memcpy(&next, buf, sizeof(next));
+            if ((off_t)next < base || (off_t)next >= end || (next - base) % READ_SIZE)
+            {
+                ++c.broken;
+                next = base + rng() % blocks * READ_SIZE;
+            }
+            off = next;
+        }
+        c.lookups.emplace_back(1e-3 * duration_cast<nanoseconds>(steady_clock::now() - start).count());
+        c.reads.emplace_back(1e-3 * read_ns);
+        monitor.record(tid, CHASE_DEPTH * READ_SIZE, mstart);
+        if (monitor.duration <= 0 && (!i || i * 10 / IO_ROUND > (i - 1) * 10 / IO_ROUND))
+            Log::log("[Thread ", tid, "]", "Progess ", i * 100 / IO_ROUND, "\% finished.");
+    }
+    free_buffer(buf, READ_SIZE);
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace std;
+    using namespace tai;
+
+    processArgs(argc, argv);
+    driver_prologue("chase");
+
+    if (!CHASE_DEPTH)
+    {
+        cerr << "Lookups need a depth of at least 1." << endl;
+        exit(-1);
+    }
+
+    auto blocks = part_of(0, READ_SIZE).second / READ_SIZE;
+    if (blocks < 2)
+    {
+        cerr << "Parts of " << part_of(0, 1).second << " B hold less than two blocks of " << READ_SIZE << " B." << endl;
+        exit(-1);
+    }
+    Log::log("chase: depth ", CHASE_DEPTH, ", ", blocks, " blocks of ", READ_SIZE >> 10, " KB per thread");
+
+    clients.assign(thread_num, {});
+    vector<unique_ptr<RandomWrite>> rw;
+    for (size_t i = 0; i < thread_num; ++i)
+    {
+        rw.emplace_back(RandomWrite::getInstance(testType));
+        RandomWrite::tid = i;
+        rw[i]->openfile(file_path(i));
+        auto rng = thread_rng(i, LinkStream);
+        build(rw[i].get(), part_of(i, READ_SIZE).first, blocks, rng);
+    }
+
+    vector<thread> threads;
+    Usage usage;
+    DevStat devstat(FILE_DIRS);
+    auto before = devstat.snapshot();
+    measure_after_warmup(usage, devstat, before);
+    usage.start();
+    monitor.start(thread_num);
+    for (size_t i = 0; i < thread_num; ++i)
+        threads.emplace_back(run, rw[i].get(), i, part_of(i, READ_SIZE).first, blocks);
+    for (auto& t : threads)
+        t.join();
+    final_sync();
+    monitor.finish();
+    usage.stop();
+    auto time = monitor.time();
+    for (auto& r : rw)
+        r->closefile();
+
+    // The lookups the monitor counts: those after the warm-up, or all of
+    // them if the run ended during it.
+    auto skip = monitor.measuring();
+    vector<double> all;
+    size_t bad = 0;
+    double read_sum = 0;
+    for (auto& c : clients)
+    {
+        auto from = skip ? c.warm : 0;
+        all.insert(all.end(), c.lookups.begin() + from, c.lookups.end());
+        read_sum = accumulate(c.reads.begin() + from, c.reads.end(), read_sum);
+        bad += c.broken;
+    }
+    sort(all.begin(), all.end());
+    auto reads = all.size() * CHASE_DEPTH;
+    auto read_avg = reads ? read_sum / reads : 0.;
+    auto read_rate = 1e9 * reads / time;
+    Log::log("chase, op, count, avg(us), p50, p99, max");
+    if (!all.empty())
+        Log::log("chase, lookup, ", all.size(), ", ", accumulate(all.begin(), all.end(), 0.) / all.size(), ", ",
+                all[all.size() / 2], ", ", all[all.size() * 99 / 100], ", ", all.back());
+    // Little's law: reads in flight on average, at most one per thread.
+    Log::log("chase: ", read_avg, " us per read, ", read_rate * read_avg * 1e-6, " reads in flight of ",
+            thread_num, " possible, ", bad, " broken link(s)");
+    WAIT.log();
+    usage.report(reads, thread_num);
+    devstat.report(before, devstat.snapshot());
+    Log::log("Chase test: ", testname[testType], ", ",
+            time / 1e9, " s in total, ",
+            monitor.ops() / thread_num, " lookups/thread, ",
+            CHASE_DEPTH, " reads/lookup, ",
+            READ_SIZE >> 10, " KB/read, ",
+            thread_num, " threads, ",
+            1e9 * monitor.ops() / time, " lookups/s, ",
+            read_rate, " reads/s");
+    return 0;
+}
@@ -0,0 +1,237 @@
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <memory>
+
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include "iotest.hpp"
+
+// File-to-file copy: every thread copies its part of a test file to the same
+// offset of a copy, in chunks of WRITE_SIZE, with the `copy` primitive:
+//     rw        pread into a buffer, pwrite from it
+//     cfr       copy_file_range, in the kernel, offloaded or reflinked where the filesystem can
+//     splice    splice into a pipe and out of it again
+//     sendfile  sendfile, file to file
+// The copy of fileN goes to the next directory of FILE_DIRS, so dirs=/a,/b
+// copies across volumes.  Every SYNC_RATE chunks the copy is fdatasync'ed,
+// and once more at the end, inside the measured time.  IO_ROUND chunks per
+// thread, starting over at the end of the part.
+//
+// The sources are written before the measured phase and dropped from the page
+// cache, as a backup finds them; fadvise applies to both ends.  What is left
+// cached of either afterwards is the copy's page-cache footprint.  testType,
+// the workload, read size and wait rate are not used.
+
+static std::string copy_path(size_t tid)
+{
+    auto idx = tid % file_count();
+    return FILE_DIRS[(idx + 1) % FILE_DIRS.size()] + "/copy" + std::to_string(idx);
+}
+
+static void write_source(size_t tid, off_t base, size_t size)
+{
+    int fd;
+    check(fd = open(file_path(tid).c_str(), O_CREAT | O_WRONLY, 0644), "open");
+    auto buf = alloc_buffer(WRITE_SIZE);
+    auto prng = payload_rng(tid);
+    PAYLOAD.init(buf, WRITE_SIZE, prng);
+    for (size_t i = 0; i * WRITE_SIZE < size; ++i)
+    {
+        PAYLOAD.next(buf, WRITE_SIZE, prng, i);
+        check(pwrite(fd, buf, std::min(WRITE_SIZE, size - i * WRITE_SIZE), base + i * WRITE_SIZE), "pwrite");
+    }
+    check(fdatasync(fd), "fdatasync");
+    #ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    #endif
+    close(fd);
+    free_buffer(buf, WRITE_SIZE);
+}
+
+// Copies len bytes at off; short transfers are continued.
+TAI_INLINE
+static void copy_chunk(int in, int out, off_t off, size_t len, char* buf, int pipefd[2])
+{
+    while (len)
+    {
+        ssize_t n;
+        if (COPY_METHOD == "rw")
+        {
+            check(n = pread(in, buf, len, off), "pread");
+            if (n)
+                check(n = pwrite(out, buf, n, off), "pwrite");
+        }
+        #ifdef __linux__
+        else if (COPY_METHOD == "cfr")
+        {
+            loff_t ioff = off, ooff = off;
+            check(n = copy_file_range(in, &ioff, out, &ooff, len, 0), "copy_file_range");
+        }
+        else if (COPY_METHOD == "sendfile")
+        {
+            check(lseek(out, off, SEEK_SET), "lseek");
+            off_t ioff = off;
+            check(n = sendfile(out, in, &ioff, len), "sendfile");
+        }
+        else
+        {
+            loff_t ioff = off, ooff = off;
+            check(n = splice(in, &ioff, pipefd[1], nullptr, len, SPLICE_F_MOVE), "splice in");
+            for (auto left = n; left; )
+            {
+                ssize_t m;
+                check(m = splice(pipefd[0], nullptr, out, &ooff, left, SPLICE_F_MOVE), "splice out");
+                left -= m;
+            }
+        }
+        #endif
+        if (!n)
+        {
+            std::cerr << "Source ends before offset " << off << "." << std::endl;
+            exit(-1);
+        }
+        off += n;
+        len -= n;
+    }
+}
+
+void run(size_t tid, off_t base, size_t chunks)
+{
+    using namespace std;
+    using namespace tai;
+
+    RandomWrite::tid = tid;
+    place_thread(tid);
+    int in, out, pipefd[2] = {-1, -1};
+    check(in = advise(open(file_path(tid).c_str(), O_RDONLY)), "open");
+    check(out = advise(open(copy_path(tid).c_str(), O_WRONLY)), "open");
+    #ifdef __linux__
+    if (COPY_METHOD == "splice")
+    {
+        check(pipe(pipefd), "pipe");
+        // Best effort: one chunk in flight through the pipe.
+        fcntl(pipefd[1], F_SETPIPE_SZ, (int)WRITE_SIZE);
+    }
+    #endif
+    auto buf = COPY_METHOD == "rw" ? alloc_buffer(WRITE_SIZE) : nullptr;
+    size_t i = 0;
+    for (; keep_running(i); ++i)
+    {
+        auto start = monitor.now();
+        copy_chunk(in, out, base + i % chunks * WRITE_SIZE, WRITE_SIZE, buf, pipefd);
+        if (!((i + 1) & ~-SYNC_RATE))
+            check(fdatasync(out), "fdatasync");
+        monitor.record(tid, WRITE_SIZE, start);
+        if (monitor.duration <= 0 && (!i || i * 10 / IO_ROUND > (i - 1) * 10 / IO_ROUND))
+            Log::log("[Thread ", tid, "]", "Progess ", i * 100 / IO_ROUND, "\% finished.");
+    }
+    check(fdatasync(out), "fdatasync");
+    if (buf)
+        free_buffer(buf, WRITE_SIZE);
+    if (pipefd[0] >= 0)
+    {
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+    close(in);
+    close(out);
+}
+
+// Average page-cache residency of the files, in percent.
+static double cached(const std::vector<std::string>& files)
+{
+    double sum = 0;
+    for (auto& f : files)
+        sum += std::max(0., Residency::resident(f));
+    return 100 * sum / files.size();
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace std;
+    using namespace tai;
+
+    processArgs(argc, argv);
+    driver_prologue("copy");
+
+    #ifdef __linux__
+    if (COPY_METHOD != "rw" && COPY_METHOD != "cfr" && COPY_METHOD != "splice" && COPY_METHOD != "sendfile")
+    #else
+    if (COPY_METHOD != "rw")
+    #endif
+    {
+        cerr << "Unknown copy primitive \"" << COPY_METHOD << "\"." << endl;
+        exit(-1);
+    }
+    if (TARGET != "file")
+    {
+        cerr << "Copies need the file target." << endl;
+        exit(-1);
+    }
+
+    auto chunks = part_of(0, WRITE_SIZE).second / WRITE_SIZE;
+    if (!chunks)
+    {
+        cerr << "Parts of " << part_of(0, 1).second << " B hold no chunk of " << WRITE_SIZE << " B." << endl;
+        exit(-1);
+    }
+    Log::log("copy: ", COPY_METHOD, ", ", chunks, " chunks of ", WRITE_SIZE >> 10, " KB per thread, fdatasync every ",
+            SYNC_RATE, " chunks");
+
+    vector<string> sources, copies;
+    for (size_t i = 0; i < file_count(); ++i)
+    {
+        sources.emplace_back(file_path(i));
+        copies.emplace_back(copy_path(i));
+        int fd;
+        check(fd = open(copies.back().c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644), "open");
+        close(fd);
+    }
+    for (size_t i = 0; i < thread_num; ++i)
+        write_source(i, part_of(i, WRITE_SIZE).first, chunks * WRITE_SIZE);
+    Log::log("copy: sources ", cached(sources), "% cached before");
+
+    vector<thread> threads;
+    Usage usage;
+    DevStat devstat(FILE_DIRS);
+    auto before = devstat.snapshot();
+    measure_after_warmup(usage, devstat, before);
+    Residency residency(test_files());
+    track_residency(residency);
+    usage.start();
+    monitor.start(thread_num);
+    for (size_t i = 0; i < thread_num; ++i)
+        threads.emplace_back(run, i, part_of(i, WRITE_SIZE).first, chunks);
+    for (auto& t : threads)
+        t.join();
+    final_sync();
+    monitor.finish();
+    usage.stop();
+    auto time = monitor.time();
+
+    auto src = cached(sources), dst = cached(copies);
+    Log::log("copy: ", src, "% of the sources and ", dst, "% of the copies cached after");
+    usage.report(monitor.ops(), thread_num);
+    devstat.report(before, devstat.snapshot(), monitor.ops() * WRITE_SIZE);
+    Log::log("Copy test: ", COPY_METHOD, ", ",
+            time / 1e9, " s in total, ",
+            monitor.ops() / thread_num, " chunks/thread, ",
+            WRITE_SIZE >> 10, " KB/chunk, ",
+            thread_num, " threads, ",
+            1e9 * monitor.ops() * WRITE_SIZE / time / 1048576, " MB/s, ",
+            src, "% source cached, ",
+            dst, "% copy cached");
+    return 0;
+}
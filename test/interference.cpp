@@ -0,0 +1,192 @@
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+
+#include "iotest.hpp"
+
+// Foreground latency under background load.  Of the thread_num threads, the
+// last one is the probe and the others write WRITE_SIZE at their planned
+// offsets, syncing every SYNC_RATE writes and waiting every WAIT_RATE, until
+// the probe is done.  The probe issues `probe` ops/s of READ_SIZE (workload
+// 0: reads, 1: writes, 2: alternating; with `probesync` set every probe write
+// is followed by a sync) and times each op to completion.  IO_ROUND probes,
+// or probes until the monitor stops a time-based run.  thread_num 1 gives the
+// idle baseline with the same probes.
+//
+// Service time runs from issue to completion, response time from the op's
+// slot in the probe schedule, so a probe held up by its predecessor still
+// counts the delay.
+
+static std::atomic<bool> probing(true);
+static std::vector<double> service, response;  // us
+static size_t warm_probes;                      // probes started during the warm-up
+
+static void background(RandomWrite* rw, size_t tid)
+{
+    using namespace std;
+
+    rw->tid = tid;
+    place_thread(tid);
+    rw->openfile(file_path(tid));
+    auto data = alloc_buffer(WRITE_SIZE);
+    auto prng = payload_rng(tid);
+    PAYLOAD.init(data, WRITE_SIZE, prng);
+    auto& sched = schedules[tid];
+    rw->reset_cb();
+    for (size_t i = 0; probing.load(memory_order_relaxed); ++i)
+    {
+        if (i && !(i & ~-SYNC_RATE))
+        {
+            rw->syncop();
+            if (!(i & ~-WAIT_RATE))
+                rw->wait_cb();
+        }
+        PAYLOAD.next(data, WRITE_SIZE, prng, i);
+        auto start = monitor.now();
+        rw->writeop(sched.next().offset, data);
+        monitor.record(tid, WRITE_SIZE, start);
+    }
+    rw->wait_cb();
+    rw->closefile();
+    free_buffer(data, WRITE_SIZE);
+}
+
+static void probe(RandomWrite* rw, size_t tid)
+{
+    using namespace std;
+    using namespace chrono;
+    using namespace tai;
+
+    rw->tid = tid;
+    place_thread(tid);
+    rw->openfile(file_path(tid));
+    auto data = alloc_buffer(READ_SIZE);
+    auto buf = alloc_buffer(READ_SIZE);
+    auto prng = payload_rng(tid);
+    PAYLOAD.init(data, READ_SIZE, prng);
+    auto& sched = schedules[tid];
+    auto period = nanoseconds((long long)(1e9 / PROBE_RATE));
+    auto slot = steady_clock::now();
+    for (size_t i = 0; (monitor.duration > 0 || i < IO_ROUND) && !monitor.stopped(); ++i, slot += period)
+    {
+        this_thread::sleep_until(slot);
+        auto off = sched.next().offset;
+        auto read = workload == 0 || (workload == 2 && (i & 1));
+        if (!read)
+            PAYLOAD.next(data, READ_SIZE, prng, i);
+        rw->reset_cb();
+        warm_probes += !monitor.measuring();
+        auto start = steady_clock::now();
+        if (read)
+            rw->readop(off, buf, READ_SIZE);
+        else
+        {
+            rw->writeop(off, data, READ_SIZE);
+            if (PROBE_SYNC)
+                rw->syncop();
+        }
+        // Completes the op on the async backends, a no-op on the blocking ones.
+        rw->wait_cb();
+        auto end = steady_clock::now();
+        service.push_back(1e-3 * duration_cast<nanoseconds>(end - start).count());
+        response.push_back(1e-3 * duration_cast<nanoseconds>(end - slot).count());
+        if (monitor.duration <= 0 && (!i || i * 10 / IO_ROUND > (i - 1) * 10 / IO_ROUND))
+            Log::log("[Probe]", "Progess ", i * 100 / IO_ROUND, "\% finished.");
+    }
+    probing = false;
+    rw->closefile();
+    free_buffer(data, READ_SIZE);
+    free_buffer(buf, READ_SIZE);
+}
+
+static void log_latency(const char* kind, std::vector<double>& lats)
+{
+    using namespace tai;
+
+    if (lats.empty())
+        return;
+    std::sort(lats.begin(), lats.end());
+    auto at = [&](double q){ return lats[std::min(lats.size() - 1, (size_t)(q * lats.size()))]; };
+    Log::log("interference, ", kind, ", ", lats.size(), ", ",
+            std::accumulate(lats.begin(), lats.end(), 0.) / lats.size(), ", ",
+            at(.5), ", ", at(.9), ", ", at(.99), ", ", at(.999), ", ", lats.back());
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace std;
+    using namespace tai;
+
+    processArgs(argc, argv);
+    // At least the probe, which is the last thread.
+    driver_prologue("interference");
+
+    if (workload > 2 || PROBE_RATE <= 0)
+    {
+        cerr << "Probe workload must be 0 (read), 1 (write) or 2 (alternating) at a positive rate." << endl;
+        exit(-1);
+    }
+    auto writers = thread_num - 1;
+    Log::log("interference: ", writers, " background writer(s) of ", WRITE_SIZE >> 10, " KB, probe ",
+            wlname[workload], " of ", READ_SIZE >> 10, " KB at ", PROBE_RATE, " ops/s",
+            PROBE_SYNC ? ", probe writes synced" : "");
+
+    // Every thread has its own RandomWrite, so the probe only ever waits for its own ops.
+    vector<unique_ptr<RandomWrite>> rw;
+    for (size_t i = 0; i < thread_num; ++i)
+    {
+        rw.emplace_back(RandomWrite::getInstance(testType));
+        plan(i, IO_ROUND, i == writers && workload == 0, i == writers ? READ_SIZE : WRITE_SIZE);
+    }
+    service.reserve(IO_ROUND);
+    response.reserve(IO_ROUND);
+
+    vector<thread> threads;
+    Usage usage;
+    DevStat devstat(FILE_DIRS);
+    auto before = devstat.snapshot();
+    measure_after_warmup(usage, devstat, before);
+    usage.start();
+    monitor.start(thread_num);
+    for (size_t i = 0; i < writers; ++i)
+        threads.emplace_back(background, rw[i].get(), i);
+    probe(rw[writers].get(), writers);
+    for (auto& t : threads)
+        t.join();
+    final_sync();
+    monitor.finish();
+    usage.stop();
+    auto time = monitor.time();
+    // The probes the monitor's time covers: those after the warm-up, or all
+    // of them if the run ended during it.
+    if (monitor.measuring())
+    {
+        service.erase(service.begin(), service.begin() + warm_probes);
+        response.erase(response.begin(), response.begin() + warm_probes);
+    }
+
+    Log::log("interference, latency, count, avg(us), p50, p90, p99, p99.9, max");
+    log_latency("service", service);
+    log_latency("response", response);
+    auto p99 = service.empty() ? 0. : service[service.size() * 99 / 100];
+    WAIT.log();
+    usage.report(monitor.ops() + service.size(), thread_num);
+    devstat.report(before, devstat.snapshot());
+    Log::log("Interference test: ", testname[testType], ", ",
+            time / 1e9, " s in total, ",
+            writers, " writers, ",
+            1e9 * monitor.ops() * WRITE_SIZE / time / 1048576, " MB/s background, ",
+            service.size(), " probes, ",
+            p99, " us p99 probe latency");
+    return 0;
+}
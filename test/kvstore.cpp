@@ -0,0 +1,465 @@
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <thread>
+#include <memory>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#include "iotest.hpp"
+
+// Hash-indexed page store: every thread owns a store in its part of its file
+// with WRITE_SIZE pages.  The first half of the part holds one primary page
+// per bucket, the second half overflow pages handed out in order; a page
+// header links the chain of a bucket.  The only in-memory state is the bucket
+// count and the next free overflow page, so every op walks its chain on disk.
+//
+//     get     reads the chain up to the key
+//     put     reads the chain, then rewrites the sectors of the record in place,
+//             or appends it to the last page, or links a new overflow page
+//     delete  reads the chain, moves the page's last record into the hole and
+//             rewrites the sectors up to it
+//
+// Keys are drawn with Zipfian skew `zipf` from `keys` keys per thread (by
+// default 3/4 of the primary capacity), ops from `kvmix` (get:put:delete
+// weights).  Stores are bulk loaded with every key before the measured phase.
+// IO_ROUND ops per thread, a sync every SYNC_RATE puts and deletes; testType
+// selects the backend, the workload and the read size are not used.
+
+enum KVOp { Get, Put, Delete, KV_OPS };
+static const char* opname[] = {"get", "put", "delete"};
+
+struct OpStats
+{
+    std::vector<double> lats;   // us
+    size_t reads = 0, writes = 0, hits = 0;
+};
+
+static std::vector<std::vector<OpStats>> stats;     // [tid][op]
+
+// Sector the store rewrites on path: the logical block size of a block device,
+// else the preferred I/O size of the file, 4 KB if neither is known.  Smaller
+// writes fail with O_DIRECT.
+static size_t sector_of(const std::string& path)
+{
+    size_t size = 4096;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return size;
+    struct stat st;
+    if (!fstat(fd, &st))
+    {
+        #ifdef BLKSSZGET
+        int ss;
+        if (S_ISBLK(st.st_mode) && !ioctl(fd, BLKSSZGET, &ss) && ss > 0)
+            size = ss;
+        else
+        #endif
+        if (st.st_blksize > 0)
+            size = st.st_blksize;
+    }
+    close(fd);
+    return size;
+}
+
+class KVStore
+{
+    struct Header
+    {
+        uint32_t magic, count;
+        uint64_t next;          // offset of the next page of the chain, 0 at its end
+    };
+
+    static constexpr uint32_t MAGIC = 0x4b565047;   // "KVPG"
+    static constexpr size_t MAX_CHAIN = 256;
+
+    RandomWrite* rw;
+    size_t page, sector, rec, slots, buckets;
+    off_t base, overflow, bump, limit;
+    std::vector<char*> bufs;    // pages of the chain walked last
+    std::vector<off_t> offs;
+    size_t depth = 0;
+
+    size_t bucket(uint64_t key) const
+    {
+        return (key * 0x9e3779b97f4a7c15ull >> 17) % buckets;
+    }
+
+    char* record(char* buf, size_t i) const
+    {
+        return buf + sizeof(Header) + i * rec;
+    }
+
+    uint64_t key_at(char* buf, size_t i) const
+    {
+        uint64_t key;
+        memcpy(&key, record(buf, i), sizeof(key));
+        return key;
+    }
+
+    // Pages the store never wrote, or left torn, read as empty.
+    Header* header(char* buf) const
+    {
+        auto h = (Header*)buf;
+        if (h->magic != MAGIC || h->count > slots ||
+                (h->next && (h->next < overflow || h->next >= limit || (h->next - base) % page)))
+            *h = {MAGIC, 0, 0};
+        return h;
+    }
+
+    char* chain_buf(size_t d)
+    {
+        for (; bufs.size() <= d; offs.emplace_back(0))
+            bufs.emplace_back(alloc_buffer(page));
+        return bufs[d];
+    }
+
+    // Rewrites bytes [from, to) of chain page d, widened to whole sectors.
+    void write(size_t d, size_t from, size_t to)
+    {
+        auto lo = from / sector * sector, hi = std::min(page, (to + sector - 1) / sector * sector);
+        rw->writeop(offs[d] + lo, bufs[d] + lo, hi - lo);
+        ++writes;
+    }
+
+    // Reads the chain of key's bucket up to the page holding key.  Returns the
+    // index of its record in page depth - 1, or -1 once the whole chain is read.
+    long walk(uint64_t key)
+    {
+        depth = 0;
+        off_t off = base + bucket(key) * page;
+        do
+        {
+            auto buf = chain_buf(depth);
+            offs[depth++] = off;
+            rw->readop(off, buf, page);
+            rw->wait_cb();
+            ++reads;
+            auto h = header(buf);
+            for (size_t i = 0; i < h->count; ++i)
+                if (key_at(buf, i) == key)
+                    return i;
+            off = h->next;
+        }
+        while (off && depth < MAX_CHAIN);
+        return -1;
+    }
+
+public:
+    size_t reads = 0, writes = 0, full = 0;
+
+    KVStore(RandomWrite* rw, off_t base, size_t len, size_t page, size_t sector) :
+            rw(rw), page(page), sector(std::min(page, sector)), base(base)
+    {
+        rec = sizeof(uint64_t) + KV_VALUE;
+        slots = page > sizeof(Header) ? (page - sizeof(Header)) / rec : 0;
+        buckets = len / page / 2;
+        overflow = bump = base + buckets * page;
+        limit = base + len / page * page;
+    }
+
+    ~KVStore()
+    {
+        for (auto b : bufs)
+            free_buffer(b, page);
+    }
+
+    size_t capacity() const
+    {
+        return buckets * slots;
+    }
+
+    size_t overflow_pages() const
+    {
+        return (bump - overflow) / page;
+    }
+
+    // Writes every bucket with keys 1..keys, overflowing into chains where needed.
+    void load(size_t keys, const char* value)
+    {
+        std::vector<std::pair<size_t, uint64_t>> order(keys);
+        for (size_t k = 0; k < keys; ++k)
+            order[k] = {bucket(k + 1), k + 1};
+        std::sort(order.begin(), order.end());
+        auto buf = chain_buf(0);
+        auto h = (Header*)buf;
+        size_t j = 0;
+        for (size_t b = 0; b < buckets; ++b)
+        {
+            off_t off = base + b * page;
+            memset(buf, 0, page);
+            *h = {MAGIC, 0, 0};
+            for (; j < order.size() && order[j].first == b; ++j)
+            {
+                if (h->count == slots)
+                {
+                    if (bump + (off_t)page > limit)
+                    {
+                        ++full;
+                        continue;
+                    }
+                    h->next = bump;
+                    rw->writeop(off, buf, page);
+                    rw->wait_cb();
+                    off = bump;
+                    bump += page;
+                    memset(buf, 0, page);
+                    *h = {MAGIC, 0, 0};
+                }
+                memcpy(record(buf, h->count), &order[j].second, sizeof(uint64_t));
+                memcpy(record(buf, h->count++) + sizeof(uint64_t), value, KV_VALUE);
+            }
+            rw->writeop(off, buf, page);
+            rw->wait_cb();
+        }
+        rw->syncop();
+        rw->wait_cb();
+        // The worker allocates its chain pages anew, where it runs.
+        for (auto b : bufs)
+            free_buffer(b, page);
+        bufs.clear();
+        offs.clear();
+    }
+
+    bool get(uint64_t key, char* value)
+    {
+        auto i = walk(key);
+        if (i < 0)
+            return false;
+        memcpy(value, record(bufs[depth - 1], i) + sizeof(uint64_t), KV_VALUE);
+        return true;
+    }
+
+    // Returns whether key was there before.
+    bool put(uint64_t key, const char* value)
+    {
+        auto i = walk(key);
+        auto d = depth - 1;
+        auto buf = bufs[d];
+        auto h = header(buf);
+        if (i >= 0)
+        {
+            memcpy(record(buf, i) + sizeof(uint64_t), value, KV_VALUE);
+            write(d, record(buf, i) - buf, record(buf, i + 1) - buf);
+        }
+        else if (h->count < slots)
+        {
+            memcpy(record(buf, h->count), &key, sizeof(key));
+            memcpy(record(buf, h->count++) + sizeof(uint64_t), value, KV_VALUE);
+            write(d, 0, record(buf, h->count) - buf);
+        }
+        else if (h->next || bump + (off_t)page > limit)
+            ++full;
+        else
+        {
+            // The new page goes out before the link to it.
+            auto fresh = chain_buf(depth);
+            buf = bufs[d];
+            h = (Header*)buf;
+            memset(fresh, 0, page);
+            *(Header*)fresh = {MAGIC, 1, 0};
+            memcpy(record(fresh, 0), &key, sizeof(key));
+            memcpy(record(fresh, 0) + sizeof(uint64_t), value, KV_VALUE);
+            offs[depth] = bump;
+            rw->writeop(bump, fresh, page);
+            ++writes;
+            rw->wait_cb();
+            h->next = bump;
+            bump += page;
+            write(d, 0, sizeof(Header));
+        }
+        // Completed before the buffers are read into again.
+        rw->wait_cb();
+        return i >= 0;
+    }
+
+    bool del(uint64_t key)
+    {
+        auto i = walk(key);
+        if (i < 0)
+            return false;
+        auto buf = bufs[depth - 1];
+        auto h = header(buf);
+        if ((size_t)i != --h->count)
+            memcpy(record(buf, i), record(buf, h->count), rec);
+        write(depth - 1, 0, record(buf, i + 1) - buf);
+        rw->wait_cb();
+        return true;
+    }
+};
+
+static std::unique_ptr<Zipf> zipf;
+static double mix[KV_OPS];
+
+void run(KVStore* store, RandomWrite* rw, size_t tid)
+{
+    using namespace std;
+    using namespace chrono;
+    using namespace tai;
+
+    rw->tid = tid;
+    place_thread(tid);
+    auto rng = thread_rng(tid);
+    auto prng = payload_rng(tid);
+    auto value = alloc_buffer(KV_VALUE), out = alloc_buffer(KV_VALUE);
+    PAYLOAD.init(value, KV_VALUE, prng);
+    size_t mutations = 0;
+    for (size_t i = 0; keep_running(i); ++i)
+    {
+        auto r = rng.real() * (mix[Get] + mix[Put] + mix[Delete]);
+        auto op = r < mix[Get] ? Get : r < mix[Get] + mix[Put] ? Put : Delete;
+        auto key = (*zipf)(rng) + 1;
+        if (op == Put)
+            PAYLOAD.next(value, KV_VALUE, prng, i);
+        auto reads = store->reads, writes = store->writes;
+        auto start = steady_clock::now();
+        auto mstart = monitor.now();
+        auto hit = op == Get ? store->get(key, out) : op == Put ? store->put(key, value) : store->del(key);
+        if (op != Get && !(++mutations & ~-SYNC_RATE))
+        {
+            rw->syncop();
+            rw->wait_cb();
+        }
+        auto& s = stats[tid][op];
+        s.lats.emplace_back(1e-3 * duration_cast<nanoseconds>(steady_clock::now() - start).count());
+        s.reads += store->reads - reads;
+        s.writes += store->writes - writes;
+        s.hits += hit;
+        monitor.record(tid, KV_VALUE, mstart);
+        if (monitor.duration <= 0 && (!i || i * 10 / IO_ROUND > (i - 1) * 10 / IO_ROUND))
+            Log::log("[Thread ", tid, "]", "Progess ", i * 100 / IO_ROUND, "\% finished.");
+    }
+    free_buffer(value, KV_VALUE);
+    free_buffer(out, KV_VALUE);
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace std;
+    using namespace tai;
+
+    processArgs(argc, argv);
+    driver_prologue("kvstore");
+
+    if (sscanf(KV_MIX.c_str(), "%lf:%lf:%lf", mix + Get, mix + Put, mix + Delete) != 3 ||
+            min({mix[Get], mix[Put], mix[Delete]}) < 0 || mix[Get] + mix[Put] + mix[Delete] <= 0)
+    {
+        cerr << "Illegal op mix \"" << KV_MIX << "\", expected get:put:delete weights." << endl;
+        exit(-1);
+    }
+    if (ZIPF_THETA < 0 || ZIPF_THETA >= 1)
+    {
+        cerr << "Zipf skew must be in [0, 1)." << endl;
+        exit(-1);
+    }
+
+    auto page = WRITE_SIZE;
+    vector<unique_ptr<RandomWrite>> rw;
+    vector<unique_ptr<KVStore>> stores;
+    stats.resize(thread_num);
+    for (size_t i = 0; i < thread_num; ++i)
+    {
+        rw.emplace_back(RandomWrite::getInstance(testType));
+        RandomWrite::tid = i;
+        rw[i]->openfile(file_path(i));
+        auto part = part_of(i, page);
+        stores.emplace_back(new KVStore(rw[i].get(), part.first, part.second, page, sector_of(file_path(i))));
+        stats[i].assign(KV_OPS, {});
+    }
+    if (!stores[0]->capacity())
+    {
+        cerr << "Pages of " << page << " B hold no " << KV_VALUE << " B value in " << part_of(0, page).second << " B per thread." << endl;
+        exit(-1);
+    }
+    if (!KV_KEYS)
+        KV_KEYS = stores[0]->capacity() * 3 / 4;
+    zipf.reset(new Zipf(KV_KEYS, ZIPF_THETA));
+    Log::log("kv: ", KV_KEYS, " keys of ", KV_VALUE, " B per thread, ", stores[0]->capacity(), " primary slots in ",
+            page, " B pages, mix ", KV_MIX, " (get:put:delete), zipf ", ZIPF_THETA);
+
+    auto value = alloc_buffer(KV_VALUE);
+    auto prng = payload_rng(0);
+    PAYLOAD.init(value, KV_VALUE, prng);
+    for (size_t i = 0; i < thread_num; ++i)
+    {
+        RandomWrite::tid = i;
+        stores[i]->load(KV_KEYS, value);
+    }
+    free_buffer(value, KV_VALUE);
+    size_t loaded_overflow = 0;
+    for (auto& s : stores)
+        loaded_overflow += s->overflow_pages();
+    Log::log("kv: loaded, ", loaded_overflow, " overflow page(s)");
+
+    vector<thread> threads;
+    Usage usage;
+    DevStat devstat(FILE_DIRS);
+    auto before = devstat.snapshot();
+    measure_after_warmup(usage, devstat, before);
+    usage.start();
+    monitor.start(thread_num);
+    for (size_t i = 0; i < thread_num; ++i)
+        threads.emplace_back(run, stores[i].get(), rw[i].get(), i);
+    for (auto& t : threads)
+        t.join();
+    final_sync();
+    monitor.finish();
+    usage.stop();
+    auto time = monitor.time();
+
+    Log::log("kv, op, count, hit%, avg(us), p50, p99, max, reads/op, writes/op");
+    for (size_t op = 0; op < KV_OPS; ++op)
+    {
+        vector<double> all;
+        size_t reads = 0, writes = 0, hits = 0;
+        for (size_t t = 0; t < thread_num; ++t)
+        {
+            auto& s = stats[t][op];
+            all.insert(all.end(), s.lats.begin(), s.lats.end());
+            reads += s.reads;
+            writes += s.writes;
+            hits += s.hits;
+        }
+        if (all.empty())
+            continue;
+        sort(all.begin(), all.end());
+        Log::log("kv, ", opname[op], ", ", all.size(), ", ", 100. * hits / all.size(), ", ",
+                accumulate(all.begin(), all.end(), 0.) / all.size(), ", ",
+                all[all.size() / 2], ", ", all[all.size() * 99 / 100], ", ", all.back(), ", ",
+                (double)reads / all.size(), ", ", (double)writes / all.size());
+    }
+    size_t overflow = 0, full = 0;
+    for (auto& s : stores)
+    {
+        overflow += s->overflow_pages();
+        full += s->full;
+    }
+    Log::log("kv: ", overflow - loaded_overflow, " overflow page(s) linked, ", full, " key(s) dropped on full chains");
+    WAIT.log();
+    usage.report(monitor.ops(), thread_num);
+    devstat.report(before, devstat.snapshot());
+
+    stores.clear();
+    for (auto& r : rw)
+        r->closefile();
+    Log::log("KV test: ", testname[testType], ", ",
+            time / 1e9, " s in total, ",
+            monitor.ops() / thread_num, " ops/thread, ",
+            page >> 10, " KB/page, ",
+            thread_num, " threads, ",
+            1e9 * monitor.ops() / time, " ops/s");
+    return 0;
+}
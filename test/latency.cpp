@@ -21,28 +21,37 @@ int main(int argc, char *argv[])
     using namespace tai;
 
     processArgs(argc, argv);
+    first_phase_only();
+    place_thread(0);
 
     auto rw = RandomWrite::getInstance(testType);
-    rw->openfile("tmp/file0");
+    rw->openfile(file_path(0));
 
-    auto data = new
-        #ifndef __MACH__
-        //(align_val_t(512))
-        #endif
-        char[WRITE_SIZE];
-    memset(data, 'a', WRITE_SIZE);
+    auto data = alloc_buffer(WRITE_SIZE);
+    auto prng = payload_rng(0);
+    PAYLOAD.init(data, WRITE_SIZE, prng);
+    plan(0, IO_ROUND, false, WRITE_SIZE);
+    auto& sched = schedules[0];
 
     auto sum_issue = 0ull, sum_sync = 0ull; 
     auto tot_rnd = IO_ROUND / SYNC_RATE;
     auto pcnt20 = tot_rnd / 5, pcnt80 = tot_rnd - pcnt20;
     vector<double> issue;
     vector<double> sync;
+    Coalescer co(false);
     for (int T = 0; T < tot_rnd; ++T)
     {
         rw->reset_cb();
+        PAYLOAD.next(data, WRITE_SIZE, prng, T);
 
         auto start = high_resolution_clock::now();
-        for (auto i = SYNC_RATE; i--; rw->writeop(randgen(WRITE_SIZE), data));
+        if (VECTORED)
+        {
+            for (auto i = SYNC_RATE; i--; co.add(sched.next().offset, data, WRITE_SIZE));
+            co.flush(rw.get());
+        }
+        else
+            for (auto i = SYNC_RATE; i--; rw->writeop(sched.next().offset, data));
         auto mid = high_resolution_clock::now();
         rw->syncop();
         rw->busywait_cb();
@@ -60,6 +69,8 @@ int main(int argc, char *argv[])
     double mid_sync = sync[sync.size() / 2], pcnt20_sync = sync[pcnt20], pcnt80_sync = sync[pcnt80];
     double avg_sync = accumulate(avg_st_sync,  avg_en_sync, 0.) / (avg_en_sync - avg_st_sync);
 
+    log_merges();
+    WAIT.log();
     Log::log("testType, X of IO, size per IO(KB),",
             " 20 percentile of issuing(us), average, median, 80 percentile,",
             " 20 percentile of syncing, average, median, 80 percentile");
@@ -69,7 +80,7 @@ int main(int argc, char *argv[])
     rw->cleanup();
     rw->closefile();
 
-    delete[] data;
+    free_buffer(data, WRITE_SIZE);
 
 //    if (testType == 5)
 //        aio_end();
@@ -0,0 +1,233 @@
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <thread>
+#include <memory>
+
+#include <sys/stat.h>
+
+#include "iotest.hpp"
+
+// Small-file churn: every thread creates a temp file, extends it with
+// `appends` writes of WRITE_SIZE, syncs it with the `msync` primitive,
+// renames it into place and unlinks it once WAIT_RATE newer files exist.
+// With `dirsync` set, every SYNC_RATE files each directory a rename or
+// unlink touched since the last time is fsync'ed.  IO_ROUND files per thread.
+//
+//     msync:  fsync | fdatasync | osync (O_SYNC) | dsync (O_DSYNC) | syncfs | none
+//     layout: shared (one dir) | thread (a dir per thread) | fanout:N (N dirs, hashed)
+//
+// testType and the read size are not used; files go to meta/ in FILE_DIRS.
+
+enum MetaOp { Create, Write, Sync, Close, Rename, Unlink, DirSync, META_OPS };
+static const char* opname[] = {"create", "write", "sync", "close", "rename", "unlink", "dirsync"};
+
+static std::vector<std::vector<std::vector<double>>> lats;      // [tid][op], us
+
+static std::string meta_root(size_t tid)
+{
+    return FILE_DIRS[tid % FILE_DIRS.size()] + "/meta";
+}
+
+static size_t fanout()
+{
+    return META_LAYOUT.compare(0, 7, "fanout:") ? 0 : std::stoull(META_LAYOUT.substr(7));
+}
+
+static std::string meta_dir(size_t tid, size_t file)
+{
+    if (META_LAYOUT == "shared")
+        return meta_root(tid);
+    if (META_LAYOUT == "thread")
+        return meta_root(tid) + "/t" + std::to_string(tid);
+    return meta_root(tid) + "/d" + std::to_string((tid * 0x9e3779b1 ^ file) % fanout());
+}
+
+static void make_dir(const std::string& dir)
+{
+    using namespace std;
+
+    if (mkdir(dir.c_str(), 0755) && errno != EEXIST)
+    {
+        cerr << "Error " << errno << ": " << strerror(errno) << " at mkdir " << dir << "." << endl;
+        exit(-1);
+    }
+}
+
+template<typename F>
+TAI_INLINE
+static auto timed(size_t tid, MetaOp op, F&& f)
+{
+    using namespace std::chrono;
+
+    auto start = steady_clock::now();
+    auto res = f();
+    lats[tid][op].emplace_back(1e-3 * duration_cast<nanoseconds>(steady_clock::now() - start).count());
+    return res;
+}
+
+void run(int tid)
+{
+    using namespace std;
+    using namespace tai;
+
+    RandomWrite::tid = tid;
+    place_thread(tid);
+    lats[tid].assign(META_OPS, {});
+
+    auto flags = O_CREAT | O_WRONLY | O_TRUNC;
+    if (META_SYNC == "osync")
+        flags |= O_SYNC;
+    else if (META_SYNC == "dsync")
+        flags |= O_DSYNC;
+
+    auto data = alloc_buffer(WRITE_SIZE);
+    auto prng = payload_rng(tid);
+    PAYLOAD.init(data, WRITE_SIZE, prng);
+    map<string, int> dirfds;
+    auto dirsync = [&](const string& dir){
+        auto& fd = dirfds[dir];
+        if (!fd)
+            check(fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY), "open dir");
+        check(timed(tid, DirSync, [&](){ return fsync(fd); }), "fsync dir");
+    };
+
+    auto prefix = "/" + to_string(tid) + ".";
+    deque<pair<string, string>> live;    // dir, name
+    set<string> dirty;                  // dirs renamed or unlinked in since the last dirsync
+    size_t i = 0;
+    for (; keep_running(i); ++i)
+    {
+        auto start = monitor.now();
+        auto dir = meta_dir(tid, i);
+        auto tmp = dir + prefix + to_string(i) + ".tmp";
+        auto name = dir + prefix + to_string(i);
+
+        int fd;
+        check(fd = timed(tid, Create, [&](){ return open(tmp.c_str(), flags, 0644); }), "create");
+        for (size_t j = 0; j < META_APPENDS; ++j)
+        {
+            PAYLOAD.next(data, WRITE_SIZE, prng, i * META_APPENDS + j);
+            check(timed(tid, Write, [&](){ return pwrite(fd, data, WRITE_SIZE, j * WRITE_SIZE); }), "pwrite");
+        }
+        if (META_SYNC == "fsync")
+            check(timed(tid, Sync, [&](){ return fsync(fd); }), "fsync");
+        else if (META_SYNC == "fdatasync")
+            check(timed(tid, Sync, [&](){ return fdatasync(fd); }), "fdatasync");
+        #ifdef __linux__
+        else if (META_SYNC == "syncfs")
+            check(timed(tid, Sync, [&](){ return syncfs(fd); }), "syncfs");
+        #endif
+        check(timed(tid, Close, [&](){ return close(fd); }), "close");
+        check(timed(tid, Rename, [&](){ return rename(tmp.c_str(), name.c_str()); }), "rename");
+
+        live.emplace_back(dir, name);
+        dirty.insert(dir);
+        if (live.size() > WAIT_RATE)
+        {
+            dirty.insert(live.front().first);
+            check(timed(tid, Unlink, [&](){ return unlink(live.front().second.c_str()); }), "unlink");
+            live.pop_front();
+        }
+        if (META_DIRSYNC && !((i + 1) & ~-SYNC_RATE))
+        {
+            for (auto& d : dirty)
+                dirsync(d);
+            dirty.clear();
+        }
+        monitor.record(tid, WRITE_SIZE * META_APPENDS, start);
+        if (monitor.duration <= 0 && (!i || i * 10 / IO_ROUND > (i - 1) * 10 / IO_ROUND))
+            Log::log("[Thread ", tid, "]", "Progess ", i * 100 / IO_ROUND, "\% finished.");
+    }
+
+    // Leftovers are not part of the measurement.
+    for (auto& f : live)
+        unlink(f.second.c_str());
+    for (auto& d : dirfds)
+        close(d.second);
+    free_buffer(data, WRITE_SIZE);
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace std;
+    using namespace tai;
+
+    processArgs(argc, argv);
+    driver_prologue("metadata");
+
+    static const vector<string> syncs = {"fsync", "fdatasync", "osync", "dsync", "syncfs", "none"};
+    if (find(syncs.begin(), syncs.end(), META_SYNC) == syncs.end())
+    {
+        cerr << "Unknown sync primitive \"" << META_SYNC << "\"." << endl;
+        exit(-1);
+    }
+    if (META_LAYOUT != "shared" && META_LAYOUT != "thread" && !fanout())
+    {
+        cerr << "Unknown directory layout \"" << META_LAYOUT << "\"." << endl;
+        exit(-1);
+    }
+    Log::log("metadata: sync ", META_SYNC, ", layout ", META_LAYOUT, ", dir fsync ",
+            META_DIRSYNC ? "every " + to_string(SYNC_RATE) + " file(s)" : string("off"),
+            ", ", META_APPENDS, " x ", WRITE_SIZE >> 10, " KB per file, ", WAIT_RATE, " live file(s) per thread");
+
+    for (size_t t = 0; t < thread_num; ++t)
+    {
+        make_dir(meta_root(t));
+        if (META_LAYOUT == "thread")
+            make_dir(meta_dir(t, 0));
+        for (size_t d = 0; d < fanout(); ++d)
+            make_dir(meta_root(t) + "/d" + to_string(d));
+    }
+    lats.resize(thread_num);
+
+    vector<thread> threads;
+    Usage usage;
+    DevStat devstat(FILE_DIRS);
+    auto before = devstat.snapshot();
+    measure_after_warmup(usage, devstat, before);
+    usage.start();
+    monitor.start(thread_num);
+    for (size_t i = 0; i < thread_num; ++i)
+        threads.emplace_back(run, i);
+    for (auto& t : threads)
+        t.join();
+    final_sync();
+    monitor.finish();
+    usage.stop();
+    auto time = monitor.time();
+
+    Log::log("metadata, op, count, avg(us), p50, p99, max");
+    for (size_t op = 0; op < META_OPS; ++op)
+    {
+        vector<double> all;
+        for (size_t t = 0; t < thread_num; ++t)
+            all.insert(all.end(), lats[t][op].begin(), lats[t][op].end());
+        if (all.empty())
+            continue;
+        sort(all.begin(), all.end());
+        Log::log("metadata, ", opname[op], ", ", all.size(), ", ",
+                accumulate(all.begin(), all.end(), 0.) / all.size(), ", ",
+                all[all.size() / 2], ", ", all[all.size() * 99 / 100], ", ", all.back());
+    }
+
+    usage.report(monitor.ops(), thread_num);
+    devstat.report(before, devstat.snapshot());
+    Log::log("Metadata test: ",
+            time / 1e9, " s in total, ",
+            monitor.ops() / thread_num, " files/thread, ",
+            META_APPENDS * WRITE_SIZE >> 10, " KB/file, ",
+            thread_num, " threads, ",
+            1e9 * monitor.ops() / time, " files/s");
+    return 0;
+}
@@ -18,68 +18,149 @@ static void run_common(RandomWrite* rw)
 
     char* data = nullptr;
     char* buf = nullptr;
-    rw->openfile("tmp/file" + to_string(SINGLE_FILE ? 0 : rw->tid));
+    auto prng = payload_rng(rw->tid);
+    rw->openfile(file_path(rw->tid));
     if (write)    
     {
-        data = new
-            #ifndef __MACH__
-            //(align_val_t(4096))
-            #endif
-            char[WRITE_SIZE];
-        memset(data, 'a', sizeof(WRITE_SIZE));
+        data = alloc_buffer(WRITE_SIZE);
+        PAYLOAD.init(data, WRITE_SIZE, prng);
     }
     if (read)
     {
-       buf = new
-            #ifndef __MACH__
-            //(align_val_t(4096))
-            #endif
-            char[READ_SIZE * WAIT_RATE]; 
+       buf = alloc_buffer(READ_SIZE * WAIT_RATE);
     }
-    vector<size_t> offs;
-    offs.reserve(IO_ROUND);
+    vector<size_t> offs(WAIT_RATE);    // ring of the offsets to read back
+    auto& sched = schedules[rw->tid];
+    // With VECTORED, ops are queued until the next sync/wait and recorded when issued.
+    Coalescer wco(false), rco(true);
+    auto issue = [rw](Coalescer& co, size_t size){
+        auto start = monitor.now();
+        auto n = co.size();
+        co.flush(rw);
+        for (; n--; monitor.record(rw->tid, size, start));
+    };
+    auto readback = [&](size_t i){
+        for (auto j = i - WAIT_RATE; j < i; ++j)
+            if (VECTORED)
+                rco.add(offs[j & ~-WAIT_RATE], buf + (j & ~-WAIT_RATE) * READ_SIZE, READ_SIZE);
+            else
+            {
+                auto start = monitor.now();
+                rw->readop(offs[j & ~-WAIT_RATE], buf + (j & ~-WAIT_RATE) * READ_SIZE);
+                monitor.record(rw->tid, READ_SIZE, start);
+            }
+        issue(rco, READ_SIZE);
+    };
     rw->reset_cb();
-    for (size_t i = 0; i < IO_ROUND; ++i)
+    size_t i = 0;
+    for (; keep_running(i); ++i)
     {
         if (write)
         {
             if (i && !(i & ~-SYNC_RATE))
             {
+                issue(wco, WRITE_SIZE);
                 rw->syncop();
                 if (!(i & ~-WAIT_RATE))
                 {
                     if (read)
-                        for (auto j = i - WAIT_RATE; j < i; ++j)
-                            rw->readop(offs[j], buf + (j & ~-WAIT_RATE) * READ_SIZE);
+                        readback(i);
                     rw->wait_cb();
                 }
             }
-            offs.emplace_back(randgen(WRITE_SIZE));
-            rw->writeop(offs.back(), data);
+            offs[i & ~-WAIT_RATE] = sched.next().offset;
+            // Queued vectored writes share the buffer, so a batch carries the last contents.
+            PAYLOAD.next(data, WRITE_SIZE, prng, i);
+            if (VECTORED)
+                wco.add(offs[i & ~-WAIT_RATE], data, WRITE_SIZE);
+            else
+            {
+                auto start = monitor.now();
+                rw->writeop(offs[i & ~-WAIT_RATE], data);
+                monitor.record(rw->tid, WRITE_SIZE, start);
+            }
         }
         else if (read)  // Read-only
         {
             if (i && !(i & ~-WAIT_RATE))
+            {
+                issue(rco, READ_SIZE);
                 rw->wait_cb();
-            rw->readop(randgen(READ_SIZE), buf + (i & ~-WAIT_RATE) * READ_SIZE);
+            }
+            auto off = sched.next().offset;
+            rw->prefetch(off, READ_SIZE);
+            if (VECTORED)
+                rco.add(off, buf + (i & ~-WAIT_RATE) * READ_SIZE, READ_SIZE);
+            else
+            {
+                auto start = monitor.now();
+                rw->readop(off, buf + (i & ~-WAIT_RATE) * READ_SIZE);
+                monitor.record(rw->tid, READ_SIZE, start);
+            }
         }
-        if (!i || i * 10 / IO_ROUND > (i - 1) * 10 / IO_ROUND)
+        if (monitor.duration <= 0 && (!i || i * 10 / IO_ROUND > (i - 1) * 10 / IO_ROUND))
             Log::log("[Thread ", rw->tid, "]", "Progess ", i * 100 / IO_ROUND, "\% finished.");
     }
-    if (read && write)
-        for (auto j = IO_ROUND - WAIT_RATE; j < IO_ROUND; ++j)
-            rw->readop(offs[j], buf + (j & ~-WAIT_RATE) * READ_SIZE);
+    issue(wco, WRITE_SIZE);
+    issue(rco, READ_SIZE);
+    if (read && write && i)
+        readback(i);
     rw->closefile();
-    operator delete[](data
-            #ifndef __MACH__
-            //, align_val_t(4096)
-            #endif
-            );
-    operator delete[](buf
-            #ifndef __MACH__
-            //, align_val_t(4096)
-            #endif
-            );
+    if (write)
+        free_buffer(data, WRITE_SIZE);
+    if (read)
+        free_buffer(buf, READ_SIZE * WAIT_RATE);
+}
+
+// Reads and writes drawn from mixgen; an op may be followed by a sync.
+// Ops are waited for every WAIT_RATE ops, which also recycles the read buffers.
+static void run_mixed(RandomWrite* rw)
+{
+    using namespace std;
+    using namespace tai;
+
+    rw->openfile(file_path(rw->tid));
+    auto data = alloc_buffer(WRITE_SIZE);
+    auto buf = alloc_buffer(READ_SIZE * WAIT_RATE);
+    auto prng = payload_rng(rw->tid);
+    PAYLOAD.init(data, WRITE_SIZE, prng);
+    auto& sched = schedules[rw->tid];
+    rw->reset_cb();
+    for (size_t i = 0; keep_running(i); ++i)
+    {
+        if (i && !(i & ~-WAIT_RATE))
+            rw->wait_cb();
+        auto& op = sched.next();
+        auto off = op.offset;
+        if (op.read)
+            rw->prefetch(off, op.size);
+        else
+            PAYLOAD.next(data, op.size, prng, i);
+        auto start = monitor.now();
+        if (op.read)
+            rw->readop(off, buf + (i & ~-WAIT_RATE) * READ_SIZE, op.size);
+        else
+            rw->writeop(off, data, op.size);
+        monitor.record(rw->tid, op.size, start);
+        if (op.sync)
+            rw->syncop();
+        if (monitor.duration <= 0 && (!i || i * 10 / IO_ROUND > (i - 1) * 10 / IO_ROUND))
+            Log::log("[Thread ", rw->tid, "]", "Progess ", i * 100 / IO_ROUND, "\% finished.");
+    }
+    rw->closefile();
+    free_buffer(data, WRITE_SIZE);
+    free_buffer(buf, READ_SIZE * WAIT_RATE);
+}
+
+// Read-only runs read, the others write and read back what they wrote.
+static void plan_thread(size_t tid)
+{
+    if (workload == 3)
+        plan_mixed(tid, IO_ROUND);
+    else if (workload == 0)
+        plan(tid, IO_ROUND, true, READ_SIZE);
+    else
+        plan(tid, IO_ROUND, false, WRITE_SIZE);
 }
 
 void run(RandomWrite* rw, int tid)
@@ -87,65 +168,102 @@ void run(RandomWrite* rw, int tid)
     using namespace std;
 
     rw->tid = tid;
+    place_thread(tid);
 
-    array<function<void()>, 3>{
+    array<function<void()>, 4>{
         [=](){ run_common<1, 0>(rw); },
         [=](){ run_common<0, 1>(rw); },
-        [=](){ run_common<1, 1>(rw); }
+        [=](){ run_common<1, 1>(rw); },
+        [=](){ run_mixed(rw); }
     }[workload]();
 }
 
-int main(int argc, char* argv[])
+// A plain run, or one phase of a job file.
+static void run_phase()
 {
     using namespace std;
     using namespace chrono;
     using namespace tai;
 
-    processArgs(argc, argv);
-    srand(time(nullptr));
-
-    vector<thread> threads;
+    Usage usage;
+    DevStat devstat(FILE_DIRS);
+    auto before = devstat.snapshot();
+    measure_after_warmup(usage, devstat, before);
+    Residency residency(test_files());
+    track_residency(residency);
+    // The AIO backends return from readop/writeop once the op is queued.
+    monitor.submit_latency = testType == 3 || testType == 4;
 
-    time_point<high_resolution_clock> epoch;
-    long long time;
-    if (SINGLE_FILE)
+    if (PROC_MODE)
     {
-        auto rw = RandomWrite::getInstance(testType, true).release();
-        epoch = high_resolution_clock::now();
-        for (size_t i = 0; i < thread_num; ++i)
-            threads.emplace_back([&rw, i](){ run(rw, i); });
-        for (auto& t : threads)
-            t.join();
-        time = duration_cast<nanoseconds>(high_resolution_clock::now() - epoch).count();
-        delete rw;
+        // Every worker process has its own RandomWrite, i.e. its own fds and AIO context.
+        check_backend_threads(testType);
+        monitor.setup(thread_num);
+        usage.start(true);
+        fork_workers(thread_num, [](){ monitor.start(); }, [](size_t i, auto ready){
+            plan_thread(i);
+            auto rw = RandomWrite::getInstance(testType);
+            ready();
+            run(rw.get(), i);
+        });
+        final_sync();
+        monitor.finish();
+        usage.stop();
     }
     else
     {
+        // Threads sharing a file share its RandomWrite instance.
+        vector<thread> threads;
+        auto files = file_count();
         vector<RandomWrite*> rw;
+        for (size_t i = 0; i < files; ++i)
+            rw.emplace_back(RandomWrite::getInstance(testType, files < thread_num).release());
+        for (size_t i = 0; i < thread_num; ++i)
+            plan_thread(i);
+        usage.start();
+        monitor.start(thread_num);
         for (size_t i = 0; i < thread_num; ++i)
-            rw.emplace_back(RandomWrite::getInstance(testType).release());
-        epoch = high_resolution_clock::now();
-        for (size_t i = 0; i < rw.size(); ++i)
-            threads.emplace_back([&rw, i](){ run(rw[i], i); });
+            threads.emplace_back([&rw, i](){ run(rw[i % rw.size()], i); });
         for (auto& t : threads)
             t.join();
-        time = duration_cast<nanoseconds>(high_resolution_clock::now() - epoch).count();
+        final_sync();
+        monitor.finish();
+        usage.stop();
         for (auto i : rw)
             delete i;
     }
+    auto time = monitor.time();
+    log_accounting();
+    log_merges();
+    WAIT.log();
+    usage.report(PROC_MODE ? monitor.all_ops() : monitor.ops(), max_inflight());
+    devstat.report(before, devstat.snapshot());
+    if (RESIDENCY && TARGET == "file")
+        residency.log("end");
 
-    Log::log(testname[testType], " random ", wlname[workload], ": ",
+    Log::log(testname[testType], ACCESS == "random" ? " random " : ACCESS == "seq" ? " sequential " : " strided ", wlname[workload], ": ",
             time / 1e9, " s in total, ",
             #ifdef _POSIX_VERSION
             aio_lockedtime() / 1e9, " s holding lock, ",
             aio_avg_true_iotime() / 1e9, " s avg true io time, ",
             aio_avg_waittime() / 1e9, " s avg wait time, ",
             #endif
-            IO_ROUND * (int(workload == 2) + 1), " ops/thread, ",
+            monitor.ops() / thread_num, " ops/thread, ",
             READ_SIZE >> 10, " KB/read, " ,
             WRITE_SIZE >> 10, " KB/write, ", 
             thread_num, " threads, ",
-            1e9 * IO_ROUND * (int(workload == 2) + 1) * thread_num / time, " iops");
+            1e9 * monitor.ops() / time, " iops");
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace std;
+    using namespace tai;
+
+    processArgs(argc, argv);
+    do
+        run_phase();
+    while (next_phase());
 
 //    if (testType == 5 || testType == 6)
 //    {
@@ -11,60 +11,82 @@
 
 #include "iotest.hpp"
 
+// x, y, z and 16 blind writes per transaction
+static constexpr size_t TX_OFFSETS = 19;
+
 void run(RandomWrite *rw, int tid)
 {
     using namespace std;
     using namespace tai;
     char *data, *buf;
     rw->tid = tid;
-    data = new
-    #ifndef __MACH__
-        //(align_val_t(4096))
-    #endif
-        char[WRITE_SIZE * 2];
-    memset(data, 'a', sizeof(WRITE_SIZE * 2));
-    buf = new
-    #ifndef __MACH__
-        //(align_val_t(4096))
-    #endif
-        char[READ_SIZE * 2]; 
+    place_thread(tid);
+    data = alloc_buffer(WRITE_SIZE * 2);
+    auto prng = payload_rng(tid);
+    PAYLOAD.init(data, WRITE_SIZE * 2, prng);
+    buf = alloc_buffer(READ_SIZE * 2);
+    vector<TxOp> chain;
+    auto& sched = schedules[tid];
     rw->reset_cb();
     assert(READ_SIZE == WRITE_SIZE);
-    for (size_t i = 0; i < IO_ROUND; ++i)
+    for (size_t i = 0; keep_running(i); ++i)
     {
-        auto px = randgen(READ_SIZE);
-        auto py = randgen(READ_SIZE);
-        auto pz = randgen(READ_SIZE);
+        PAYLOAD.next(data, WRITE_SIZE, prng, i);
+        auto start = monitor.now();
+        auto px = sched.next().offset;
+        auto py = sched.next().offset;
+        auto pz = sched.next().offset;
         rw->readop(px, buf);
         rw->readop(py, buf + READ_SIZE);
         rw->wait_back(2);
-        for (auto j = 16; j--; rw->writeop(randgen(WRITE_SIZE), data));
-        rw->writeop(px, data);
-        //rw->syncop();
-        rw->writeop(py, data);
-        rw->syncop();
         auto dxy = (long long *)data;
         auto dz = (long long *)(data + WRITE_SIZE);
-        for (size_t j = 0; j < WRITE_SIZE / 8; ++j)
-            for (size_t k = 0; k < WRITE_SIZE / 8; k += WRITE_SIZE / 1024)
-                dz[j] = (dz[j] >> 1) ^ (dz[j] << sizeof(dz[j]) * 8 - 1) ^ dxy[k];
-        rw->writeop(pz, data + WRITE_SIZE);
-        rw->syncop();
-        if (!i || i * 10 / IO_ROUND > (i - 1) * 10 / IO_ROUND)
+        if (TX_CHAIN == 1)
+        {
+            // z only depends on the data written to x and y, so it can be
+            // computed up front and the whole commit submitted as one chain.
+            for (size_t j = 0; j < WRITE_SIZE / 8; ++j)
+                for (size_t k = 0; k < WRITE_SIZE / 8; k += WRITE_SIZE / 1024)
+                    dz[j] = (dz[j] >> 1) ^ (dz[j] << sizeof(dz[j]) * 8 - 1) ^ dxy[k];
+            chain.clear();
+            for (auto j = 16; j--; chain.push_back({false, (off_t)sched.next().offset, data, WRITE_SIZE}));
+            chain.push_back({false, (off_t)px, data, WRITE_SIZE});
+            chain.push_back({false, (off_t)py, data, WRITE_SIZE});
+            chain.push_back({true});
+            chain.push_back({false, (off_t)pz, data + WRITE_SIZE, WRITE_SIZE});
+            chain.push_back({true});
+            rw->txchain(chain);
+        }
+        else
+        {
+            // txchain=2 commits with the barriers of txchain(), so the two
+            // differ only in how the writes are submitted; by default the
+            // commits are plain syncop()s.
+            for (auto j = 16; j--; rw->writeop(sched.next().offset, data));
+            rw->writeop(px, data);
+            //rw->syncop();
+            rw->writeop(py, data);
+            if (TX_CHAIN)
+                rw->barrier();
+            else
+                rw->syncop();
+            for (size_t j = 0; j < WRITE_SIZE / 8; ++j)
+                for (size_t k = 0; k < WRITE_SIZE / 8; k += WRITE_SIZE / 1024)
+                    dz[j] = (dz[j] >> 1) ^ (dz[j] << sizeof(dz[j]) * 8 - 1) ^ dxy[k];
+            rw->writeop(pz, data + WRITE_SIZE);
+            if (TX_CHAIN)
+                rw->barrier();
+            else
+                rw->syncop();
+        }
+        monitor.record(rw->tid, 2 * READ_SIZE + 19 * WRITE_SIZE, start);
+        if (monitor.duration <= 0 && (!i || i * 10 / IO_ROUND > (i - 1) * 10 / IO_ROUND))
             Log::log("[Thread ", rw->tid, "]", "Progess ", i * 100 / IO_ROUND, "\% finished.");
     }
     rw->syncop();
     rw->cleanup();
-    operator delete[](data
-            #ifndef __MACH__
-            //, align_val_t(4096)
-            #endif
-            );
-    operator delete[](buf
-            #ifndef __MACH__
-            //, align_val_t(4096)
-            #endif
-            );
+    free_buffer(data, WRITE_SIZE * 2);
+    free_buffer(buf, READ_SIZE * 2);
 }
 
 int main(int argc, char* argv[])
@@ -74,19 +96,59 @@ int main(int argc, char* argv[])
     using namespace tai;
 
     processArgs(argc, argv);
-    srand(time(nullptr));
+    first_phase_only();
+    Usage usage;
+    DevStat devstat(FILE_DIRS);
+    auto before = devstat.snapshot();
+    measure_after_warmup(usage, devstat, before);
+    // Only file0 is opened, whatever the file layout.
+    Residency residency({file_path(0)});
+    track_residency(residency);
 
-    vector<thread> threads;
-    auto rw = RandomWrite::getInstance(testType, true).release();
-    rw->openfile("tmp/file0");
+    if (PROC_MODE)
+    {
+        check_backend_threads(testType);
+        monitor.setup(thread_num);
+        usage.start(true);
+        fork_workers(thread_num, [](){ monitor.start(); }, [](size_t i, auto ready){
+            plan(i, IO_ROUND * TX_OFFSETS, false, WRITE_SIZE);
+            auto rw = RandomWrite::getInstance(testType);
+            rw->openfile(file_path(0));
+            ready();
+            run(rw.get(), i);
+            rw->closefile();
+        });
+        final_sync();
+        monitor.finish();
+        usage.stop();
+    }
+    else
+    {
+        vector<thread> threads;
+        auto rw = RandomWrite::getInstance(testType, true).release();
+        rw->openfile(file_path(0));
+        for (size_t i = 0; i < thread_num; ++i)
+            plan(i, IO_ROUND * TX_OFFSETS, false, WRITE_SIZE);
 
-    auto start = high_resolution_clock::now();
-    for (size_t i = 0; i < thread_num; ++i)
-        threads.emplace_back([&rw](int i){ run(rw, i); }, i);
-    for (auto& t : threads)
-        t.join();
-    rw->closefile();
-    auto time = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+        usage.start();
+        monitor.start(thread_num);
+        for (size_t i = 0; i < thread_num; ++i)
+            threads.emplace_back([&rw](int i){ run(rw, i); }, i);
+        for (auto& t : threads)
+            t.join();
+        rw->closefile();
+        final_sync();
+        monitor.finish();
+        usage.stop();
+        delete rw;
+    }
+    auto time = monitor.time();
+    log_accounting();
+    WAIT.log();
+    usage.report(PROC_MODE ? monitor.all_ops() : monitor.ops(), max_inflight());
+    devstat.report(before, devstat.snapshot());
+    if (RESIDENCY && TARGET == "file")
+        residency.log("end");
 
 //    if (testType == 5 || testType == 6)
 //    {
@@ -95,12 +157,11 @@ int main(int argc, char* argv[])
 //        else
 //            TAIWrite::end();
 //    }
-    delete rw;
     Log::log(testname[testType], " TX test: ",
             time / 1e9, " s in total, ",
-            IO_ROUND, " tx/thread, ",
+            monitor.ops() / thread_num, " tx/thread, ",
             READ_SIZE >> 10, " KB/IO, " ,
             thread_num, " threads, ",
-            1e9 * IO_ROUND * thread_num / time, " iops");
+            1e9 * monitor.ops() / time, " iops");
     return 0;
 }